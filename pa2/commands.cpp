@@ -2,22 +2,38 @@
 
 #include "commands.h"
 #include "debug.h"
-#include <sstream>
+#include "image.h"
+#include <algorithm>
+#include <atomic>
+#include <regex>
 #include <iomanip>
+#include <thread>
+#include <unordered_set>
 
 command_hash cmd_hash{
+    {"begin", fn_begin},
     {"cat", fn_cat},
     {"cd", fn_cd},
+    {"commit", fn_commit},
+    {"df", fn_df},
+    {"du", fn_du},
     {"echo", fn_echo},
     {"exit", fn_exit},
+    {"find", fn_find},
+    {"grep", fn_grep},
+    {"ln", fn_ln},
+    {"load", fn_load},
     {"ls", fn_ls},
     {"lsr", fn_lsr},
     {"make", fn_make},
     {"mkdir", fn_mkdir},
+    {"mv", fn_mv},
     {"prompt", fn_prompt},
     {"pwd", fn_pwd},
     {"rm", fn_rm},
-    {"rmr", fn_rmr}};
+    {"rmr", fn_rmr},
+    {"rollback", fn_rollback},
+    {"save", fn_save}};
 
 command_fn find_command_fn(const string &cmd)
 {
@@ -34,9 +50,134 @@ command_fn find_command_fn(const string &cmd)
    return result->second;
 }
 
+bool command_writes(const string &cmd)
+{
+   static const unordered_set<string> writers{
+       "begin", "commit", "ln", "load", "make", "mkdir", "mv", "rm",
+       "rmr", "rollback"};
+   return writers.count(cmd) > 0;
+}
+
 command_error::command_error(const string &what)
     : runtime_error(what) {}
 
+pipeline::pipeline(const string &line)
+{
+   wordvec words = split(line, " \t");
+   if (words.size() == 0 || words[0][0] == '#')
+      return;
+   stages.push_back({nullptr, {}});
+   for (size_t index = 0; index < words.size(); ++index)
+   {
+      if (words[index] == "|")
+      {
+         if (stages.back().words.empty())
+            throw command_error("|: missing command");
+         stages.push_back({nullptr, {}});
+      }
+      else if (words[index] == ">")
+      {
+         if (stages.back().words.empty() || index + 2 != words.size())
+            throw command_error(">: usage: command > file");
+         target = words[++index];
+      }
+      else
+         stages.back().words.push_back(words[index]);
+   }
+   if (stages.back().words.empty())
+      throw command_error("|: missing command");
+   for (stage &each : stages)
+      each.fn = find_command_fn(each.words[0]);
+}
+
+bool pipeline::empty() const { return stages.empty(); }
+
+bool pipeline::writes() const
+{
+   if (not target.empty())
+      return true;
+   for (const stage &each : stages)
+      if (command_writes(each.words[0]))
+         return true;
+   return false;
+}
+
+// redirect -
+//    Makes the body the contents of the file at the path, making
+//    the file if it does not exist.
+
+static void redirect(inode_state &state, const string &path,
+                     file_data_ptr body)
+{
+   string name;
+   inode_ptr parent = state.resolve_parent(path, name);
+   if (name == "." || name == "..")
+      throw file_error(path + ": Is a directory");
+   directory *dirp = static_cast<directory *>(parent->file().get());
+   // A symbolic link is followed to the file it names.
+   inode_ptr file = dirp->entries().count(name) == 0
+                        ? dirp->mkfile(name)
+                        : state.resolve(path);
+   if (file->type() != file_type::PLAIN_TYPE)
+      throw file_error(path + ": Is a directory");
+   directory::write(file, move(body));
+}
+
+void pipeline::run(inode_state &state) const
+{
+   // Put back the output and input of the state however we leave.
+   struct restore
+   {
+      inode_state &state;
+      ostream &out;
+      ~restore()
+      {
+         state.setout(out);
+         state.setinput(nullptr);
+      }
+   } saved{state, state.out()};
+   file_sink sink;
+   ostream collect(&sink);
+   collect << boolalpha;
+   for (size_t index = 0; index < stages.size(); ++index)
+   {
+      bool last = index + 1 == stages.size();
+      state.setout(last && target.empty() ? saved.out : collect);
+      stages[index].fn(state, stages[index].words);
+      state.setinput(last ? nullptr : sink.take());
+   }
+   if (not target.empty())
+      redirect(state, target, sink.take());
+}
+
+// lookup -
+//    Resolves a path as a command sees it, naming the command in the
+//    error if it cannot be followed.
+
+static inode_ptr lookup(inode_state &state, const string &command,
+                        const string &path)
+{
+   try
+   {
+      return state.resolve(path);
+   }
+   catch (file_error &error)
+   {
+      throw file_error(command + ": " + error.what());
+   }
+}
+
+// print_body -
+//    Prints a file followed by a newline, unless it already ends in
+//    one, as output collected from commands does.
+
+static void print_body(ostream &out, const file_data &body)
+{
+   out << body;
+   if (body.size() == 0 || body.text().back() != '\n')
+      out << endl;
+}
+
 int exit_status_message()
 {
    int exit_status = exit_status::get();
@@ -44,87 +185,97 @@ int exit_status_message()
    return exit_status;
 }
 
+void fn_begin(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() > 1)
+      throw command_error("begin: usage: begin");
+   state.begin();
+}
+
 void fn_cat(inode_state &state, const wordvec &words)
 {
    DEBUGF('c', state);
    DEBUGF('c', words);
 
    if (words.size() == static_cast<size_t>(1))
-      return;
-
-   wordvec oldpath = vector<string>(*state.path());
-   wordvec dirs = split(words[1], "/");
-   string c = words[1];
-   if (dirs.size() > 0)
    {
-      c = dirs.back();
-      dirs.pop_back();
-      stringstream prebuff;
-      prebuff << ".";
-      for (string iter : dirs)
-         prebuff << "/" << iter;
-      fn_cd(state, vector<string>{"cd", prebuff.str()});
+      if (state.input() != nullptr)
+         print_body(state.out(), *state.input());
+      return;
    }
-   if (state.files().count(c) == 0)
-      throw file_error("cat: " + c + ": No such file or directory");
-   if (state.files()[c].get()->type() == file_type::DIRECTORY_TYPE)
-      throw file_error("cd: " + c + ": is a directory");
-   cout << state.files()[c].get()->file()->readfile() << endl;
 
-   if (dirs.size() > 0)
-   {
-      stringstream buffer;
-      for (string iter : oldpath)
-         buffer << iter << "/";
-      fn_cd(state, vector<string>{"cd"});
-      fn_cd(state, vector<string>{"cd", buffer.str()});
-   }
+   inode_ptr file = lookup(state, "cat", words[1]);
+   if (file->type() == file_type::DIRECTORY_TYPE)
+      throw file_error("cat: " + words[1] + ": is a directory");
+   print_body(state.out(), *file->file()->readfile());
 }
 
 void fn_cd(inode_state &state, const wordvec &words)
 {
    DEBUGF('c', state);
    DEBUGF('c', words);
-   if (words.size() == static_cast<size_t>(1) ||
-       words[1] == "" || words[1] == "/")
+   if (words.size() == static_cast<size_t>(1) || words[1] == "")
    {
-      state.path()->clear();
       state.set(state.top());
       return;
    }
-   if (words[1] == ".")
-      return;
-   wordvec dirs = split(words[1], "/");
-   dir files = state.files();
-   if (files.count(dirs[0]) == 0)
-      throw file_error("cd: " + dirs[0] +
-                       ": No such file or directory");
-   if (files[dirs[0]].get()->type() == file_type::PLAIN_TYPE)
-      throw file_error("cd: " + dirs[0] + ": Is a file");
-   state.set(files[dirs[0]]);
-   if (dirs[0] == "..")
-      state.path()->pop_back();
-   else
-      state.path()->push_back(dirs[0]);
-   dirs.erase(dirs.begin());
-   if (dirs.size() > 0)
+   inode_ptr next = lookup(state, "cd", words[1]);
+   if (next->type() != file_type::DIRECTORY_TYPE)
+      throw file_error("cd: " + words[1] + ": Is a file");
+   state.set(next);
+   // Fill the path cache now, so that pwd need not.
+   state.path();
+}
+
+void fn_df(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() > 1)
+      throw command_error("df: usage: df");
+   usage total = state.top()->file()->used();
+   state.out() << setw(8) << "inodes" << "  " << setw(10) << "bytes"
+               << "  " << setw(10) << "heap" << "  " << "deferred"
+               << endl
+               << setw(8) << total.inodes << "  " << setw(10)
+               << total.bytes << "  " << setw(10) << total.heap
+               << "  " << setw(8) << directory::deferred() << endl;
+}
+
+void fn_du(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   wordvec paths(words.cbegin() + 1, words.cend());
+   if (paths.empty())
+      paths.push_back(".");
+   for (const string &path : paths)
    {
-      stringstream buffer;
-      for (string iter : dirs)
-         buffer << iter << "/";
-      string newpath = buffer.str();
-      newpath.pop_back();
-      fn_cd(state, vector<string>{words[0], newpath});
+      usage total = state.resolve(path)->file()->used();
+      state.out() << setw(8) << total.inodes << "  " << setw(10)
+                  << total.bytes << "  " << setw(10) << total.heap
+                  << "  " << path << endl;
    }
 }
 
+void fn_commit(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() > 1)
+      throw command_error("commit: usage: commit");
+   state.commit();
+}
+
 void fn_echo(inode_state &state, const wordvec &words)
 {
    DEBUGF('c', state);
    DEBUGF('c', words);
    if (words.size() == static_cast<size_t>(1))
       return;
-   cout << word_range(words.cbegin() + 1, words.cend()) << endl;
+   state.out() << word_range(words.cbegin() + 1, words.cend()) << endl;
 }
 
 void fn_exit(inode_state &state, const wordvec &words)
@@ -143,103 +294,261 @@ void fn_exit(inode_state &state, const wordvec &words)
    throw ysh_exit();
 }
 
-void fn_ls(inode_state &state, const wordvec &words)
+// path_prefix -
+//    The path as given on the command line, without trailing slashes,
+//    to be put in front of the names printed by find and grep.
+
+static string path_prefix(const string &path)
+{
+   size_t end = path.find_last_not_of('/');
+   return end == string::npos ? "" : path.substr(0, end + 1);
+}
+
+// path_below -
+//    Sets path to the prefix followed by the names leading from top
+//    down to the directory self, or returns false if self is not
+//    top or below it, or is no longer linked into the tree.  Each
+//    directory knows its own name, so this costs only the depth.
+
+static bool path_below(inode_ptr self, const inode_ptr &top,
+                       const string &prefix, string &path)
+{
+   wordvec names;
+   while (self != top)
+   {
+      // Unlinked by a transaction, but not yet destroyed.
+      if (self->links() == 0)
+         return false;
+      directory *here = static_cast<directory *>(self->file().get());
+      dir files = here->entries();
+      const inode_ptr *parent = files.get("..");
+      if (parent == nullptr || *parent == self)
+         return false;
+      names.push_back(here->name());
+      self = *parent;
+   }
+   path = prefix;
+   for (auto itor = names.rbegin(); itor != names.rend(); ++itor)
+      path += "/" + *itor;
+   return true;
+}
+
+void fn_find(inode_state &state, const wordvec &words)
 {
    DEBUGF('c', state);
    DEBUGF('c', words);
-   dir files = state.files();
-   if (words.size() == static_cast<size_t>(1))
+   string where = ".";
+   size_t option = 1;
+   if (words.size() == 4)
+      where = words[option++];
+   if (words.size() != option + 2 || words[option] != "-name")
+      throw command_error("find: usage: find [path] -name pattern");
+   inode_ptr top = state.resolve(where);
+   if (top->type() != file_type::DIRECTORY_TYPE)
+      throw file_error("find: " + where + ": Not a directory");
+   if (directory::deferred() > 0)
+      directory::load_all(top);
+
+   string prefix = path_prefix(where);
+   wordvec found;
+   string path;
+   for (const auto &match : name_index::match(words[option + 1]))
+      if (path_below(match.first, top, prefix, path))
+         found.push_back(path + "/" + match.second);
+   sort(found.begin(), found.end());
+   for (const string &name : found)
+      state.out() << name << endl;
+}
+
+void fn_grep(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() < 2 || words.size() > 3)
+      throw command_error("grep: usage: grep pattern [path]");
+   regex pattern;
+   try
    {
-      cout << "/"
-           << ((state.path()->size() > 0)
-                   ? static_cast<string>(state.path()->back())
-                   : "")
-           << ":" << endl;
-      for (auto iter : files)
-         cout << setw(6) << iter.second->get_inode_nr()
-              << "  " << setw(6) << iter.second->file()->size()
-              << "  " << iter.first
-              << (iter.second->type() ==
-                              file_type::DIRECTORY_TYPE &&
-                          iter.first != "." && iter.first != ".."
-                      ? "/"
-                      : "")
-              << endl;
+      pattern = regex(words[1]);
    }
-   else
-      for (string view :
-           vector<string>(words.cbegin() + 1, words.cend()))
+   catch (regex_error &)
+   {
+      throw command_error("grep: " + words[1] + ": bad pattern");
+   }
+   string where = words.size() == 3 ? words[2] : ".";
+
+   // Collect the files in the order ls would list them, then scan
+   // their bodies in parallel and print the hits in that order.
+   // Symbolic links below the top are not followed.
+   struct grep_file
+   {
+      string path;
+      file_data_ptr data;
+      string hits;
+   };
+   vector<grep_file> files;
+   vector<pair<inode_ptr, string>> pending{
+       {state.resolve(where), path_prefix(where)}};
+   if (pending.back().first->type() == file_type::PLAIN_TYPE)
+      pending.back().second = where;
+   while (not pending.empty())
+   {
+      auto [node, path] = move(pending.back());
+      pending.pop_back();
+      if (node->type() == file_type::PLAIN_TYPE)
+      {
+         files.push_back({path, node->file()->readfile(), ""});
+         continue;
+      }
+      if (node->type() == file_type::SYMLINK_TYPE)
+         continue;
+      // Pushed in reverse, so the first entry is scanned first.
+      size_t first = pending.size();
+      for (const auto &entry :
+           static_cast<directory *>(node->file().get())->entries())
+         if (entry.first != "." && entry.first != "..")
+            pending.emplace_back(entry.second,
+                                 path + "/" + entry.first);
+      reverse(pending.begin() + first, pending.end());
+   }
+
+   atomic<size_t> next{0};
+   auto scan = [&files, &next, &pattern]() {
+      for (size_t index; (index = next++) < files.size();)
       {
-         if (view == ".")
+         grep_file &file = files[index];
+         string_view text = file.data->text();
+         for (size_t start = 0; start < text.size();)
          {
-            cout << ".:" << endl;
-            for (auto iter : files)
-               cout << setw(6) << iter.second->get_inode_nr()
-                    << "  " << setw(6)
-                    << iter.second->file()->size()
-                    << "  " << iter.first
-                    << (iter.second->type() ==
-                                    file_type::DIRECTORY_TYPE &&
-                                iter.first != "." &&
-                                iter.first != ".."
-                            ? "/"
-                            : "")
-                    << endl;
-            continue;
+            size_t end = text.find('\n', start);
+            if (end == string_view::npos)
+               end = text.size();
+            if (regex_search(text.begin() + start,
+                             text.begin() + end, pattern))
+            {
+               file.hits += file.path + ":";
+               file.hits.append(text.substr(start, end - start));
+               file.hits += "\n";
+            }
+            start = end + 1;
          }
-         wordvec oldpath = vector<string>(*state.path());
-         fn_cd(state, vector<string>{"cd", view});
-         cout << (view == "." ? "." : "/")
-              << ((state.path()->size() > 0)
-                      ? static_cast<string>(state.path()->back())
-                      : "")
-              << ":" << endl;
-         for (auto iter : state.files())
-            cout << setw(6) << iter.second->get_inode_nr()
-                 << "  " << setw(6)
-                 << iter.second->file()->size() << "  " << iter.first
-                 << (iter.second->type() ==
-                                 file_type::DIRECTORY_TYPE &&
-                             iter.first != "." &&
-                             iter.first != ".."
-                         ? "/"
-                         : "")
-                 << endl;
-         stringstream buffer;
-         buffer << ".";
-         for (string iter : oldpath)
-            buffer << "/" << iter;
-         fn_cd(state, vector<string>{"cd", buffer.str()});
       }
+   };
+   size_t workers = min<size_t>(
+       max(1u, thread::hardware_concurrency()), files.size());
+   vector<thread> pool;
+   for (size_t worker = 1; worker < workers; ++worker)
+      pool.emplace_back(scan);
+   scan();
+   for (thread &worker : pool)
+      worker.join();
+   for (const grep_file &file : files)
+      state.out() << file.hits;
+}
+
+void fn_ls(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   wordvec views(words.cbegin() + 1, words.cend());
+   if (views.empty())
+      views.push_back(".");
+   for (const string &view : views)
+   {
+      inode_ptr where = lookup(state, "ls", view);
+      if (where->type() != file_type::DIRECTORY_TYPE)
+         throw file_error("ls: " + view + ": Is a file");
+      directory *listed = static_cast<directory *>(where->file().get());
+      state.out() << listed->path() << ":" << endl;
+      for (auto iter : listed->entries())
+         directory::print_entry(state.out(), iter.first, iter.second);
+   }
+}
+
+// link_target -
+//    The directory in which ln or mv puts an entry:  inside the
+//    destination if it is a directory, under the given name, or else
+//    beside it, under its own name.  Sets name to the name to use.
+
+static directory *link_target(inode_state &state, const string &dest,
+                              const string &source_name, string &name)
+{
+   inode_ptr parent = state.resolve_parent(dest, name);
+   directory *beside = static_cast<directory *>(parent->file().get());
+   dir files = beside->entries();
+   const inode_ptr *found = files.get(name);
+   inode_ptr into = found == nullptr ? nullptr : *found;
+   if (into != nullptr && into->type() == file_type::SYMLINK_TYPE)
+      try
+      {
+         into = state.resolve(dest);
+      }
+      catch (file_error &)
+      {
+         // A link that names nothing is replaced, not followed.
+      }
+   if (into == nullptr || into->type() != file_type::DIRECTORY_TYPE)
+      return beside;
+   if (source_name.empty())
+      throw file_error(dest + ": File exists");
+   name = source_name;
+   return static_cast<directory *>(into->file().get());
+}
+
+void fn_ln(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   bool soft = words.size() == 4 && words[1] == "-s";
+   if (words.size() != (soft ? 4u : 3u))
+      throw command_error("ln: usage: ln [-s] target linkname");
+   const string &target = words[soft ? 2 : 1];
+   const string &linkname = words[soft ? 3 : 2];
+   wordvec names = split(target, "/");
+   string name;
+   directory *where = link_target(
+       state, linkname, names.empty() ? "" : names.back(), name);
+   if (where->entries().count(name) > 0)
+      throw file_error("ln: " + linkname + ": File exists");
+   if (soft)
+   {
+      where->symlink(name, target);
+      return;
+   }
+   inode_ptr file = state.resolve(target);
+   if (file->type() == file_type::DIRECTORY_TYPE)
+      throw file_error("ln: " + target +
+                       ": hard link not allowed for directory");
+   where->link(name, file);
+}
+
+void fn_load(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() != static_cast<size_t>(2))
+      throw command_error("load: usage: load imagefile");
+   if (state.in_transaction())
+      throw command_error("load: not allowed in a transaction");
+   load_image(state, words[1]);
 }
 
 void fn_lsr(inode_state &state, const wordvec &words)
 {
    DEBUGF('c', state);
    DEBUGF('c', words);
-   for (string view : vector<string>(words.cbegin(), words.cend()))
+   wordvec views(words.cbegin() + 1, words.cend());
+   if (views.empty())
+      views.push_back(".");
+   for (const string &view : views)
    {
-      wordvec oldpath = vector<string>(*state.path());
-      if (view == "lsr" &&
-          words.size() > static_cast<size_t>(1))
-         continue;
-      fn_cd(state, vector<string>{"cd", (view ==
-                                                 "lsr"
-                                             ? "."
-                                             : view)});
-      cout << (view == "." ? "." : "/")
-           << ((state.path()->size() > 0)
-                   ? static_cast<string>(state.path()->back())
-                   : "")
-           << ":" << endl;
-      static_cast<directory *>(state.cur()->file().get())
-          ->lsr(state.cur(), "");
-      stringstream buffer;
-      buffer << ".";
-      for (string iter : oldpath)
-         buffer << "/" << iter;
-      fn_cd(state, vector<string>{"cd", buffer.str()});
-      fn_cd(state, vector<string>{"cd", ".."});
+      inode_ptr where = lookup(state, "lsr", view);
+      if (where->type() != file_type::DIRECTORY_TYPE)
+         throw file_error("lsr: " + view + ": Is a file");
+      directory *listed = static_cast<directory *>(where->file().get());
+      string path = listed->path();
+      state.out() << path << ":" << endl;
+      listed->lsr(state.out(), where, path == "/" ? "" : path);
    }
 }
 
@@ -251,38 +560,20 @@ void fn_make(inode_state &state, const wordvec &words)
    if (words.size() == static_cast<size_t>(1))
       return;
 
-   wordvec oldpath = vector<string>(*state.path());
-   wordvec dirs = split(words[1], "/");
-   string f = words[1];
-   if (dirs.size() > 0)
-   {
-      f = dirs.back();
-      dirs.pop_back();
-      stringstream prebuff;
-      prebuff << ".";
-      for (string iter : dirs)
-         prebuff << "/" << iter;
-      fn_cd(state, vector<string>{"cd", prebuff.str()});
-   }
-
-   if (state.files().count(f) > 0 &&
-       state.files()[f].get()->type() ==
-           file_type::DIRECTORY_TYPE)
+   string f;
+   directory *where = static_cast<directory *>(
+       state.resolve_parent(words[1], f)->file().get());
+   // A symbolic link is followed to the file it names.
+   inode_ptr file = where->entries().count(f) == 0
+                        ? where->mkfile(f)
+                        : lookup(state, "make", words[1]);
+   if (file->type() == file_type::DIRECTORY_TYPE)
       throw file_error("make: " + f + ": Is a directory");
-   inode_ptr newfile = state.files().count(f) > 0
-                           ? state.files()[f]
-                           : state.cur()->file().get()->mkfile(f);
-   newfile->file()
-       ->writefile(vector<string>(words.cbegin() + 2, words.cend()));
-
-   if (dirs.size() > 0)
-   {
-      stringstream buffer;
-      for (string iter : oldpath)
-         buffer << iter << "/";
-      fn_cd(state, vector<string>{"cd"});
-      fn_cd(state, vector<string>{"cd", buffer.str()});
-   }
+   if (words.size() == 2 && state.input() != nullptr)
+      directory::write(file, state.input());
+   else
+      directory::write(file, make_shared<file_data>(word_range(
+                                 words.cbegin() + 2, words.cend())));
 }
 
 void fn_mkdir(inode_state &state, const wordvec &words)
@@ -292,35 +583,66 @@ void fn_mkdir(inode_state &state, const wordvec &words)
    if (words.size() == static_cast<size_t>(1))
       return;
 
-   wordvec oldpath = vector<string>(*state.path());
-   wordvec dirs = split(words[1], "/");
-   string p = words[1];
-   if (dirs.size() > 0)
-   {
-      p = dirs.back();
-      dirs.pop_back();
-      stringstream prebuff;
-      prebuff << ".";
-      for (string iter : dirs)
-         prebuff << "/" << iter;
-      fn_cd(state, vector<string>{"cd", prebuff.str()});
-   }
-
-   string name = split(p, "/").back(); //path
-   if (state.files().count(p) > 0)
+   string p;
+   inode_ptr where = state.resolve_parent(words[1], p);
+   if (static_cast<directory *>(where->file().get())
+           ->entries()
+           .count(p) > 0)
       throw file_error("mkdir: " + p + ": Directory already exists");
-   inode_ptr newdir = state.cur()->file().get()->mkdir(p);
-   static_cast<directory *>(newdir.get()->file().get())
-       ->init(state.cur(), newdir);
+   where->file()->mkdir(p);
+}
 
-   if (dirs.size() > 0)
+void fn_mv(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() != 3)
+      throw command_error("mv: usage: mv source dest");
+   string from_name;
+   inode_ptr from_dir = state.resolve_parent(words[1], from_name);
+   if (from_name == "." || from_name == "..")
+      throw file_error("mv: " + words[1] + ": cannot move");
+   directory *from = static_cast<directory *>(from_dir->file().get());
+   dir files = from->entries();
+   const inode_ptr *found = files.get(from_name);
+   if (found == nullptr)
+      throw file_error("mv: " + words[1] +
+                       ": No such file or directory");
+   inode_ptr node = *found;
+   string to_name;
+   directory *to = link_target(state, words[2], from_name, to_name);
+   if (to == from && to_name == from_name)
+      return;
+
+   // A directory may not go below itself.  Walks up from the new
+   // parent, so the cost is its depth, not the size of the subtree.
+   if (node->type() == file_type::DIRECTORY_TYPE)
+      for (inode_ptr up = to->self();;)
+      {
+         if (up == node)
+            throw file_error("mv: " + words[1] +
+                             ": cannot move a directory into itself");
+         inode_ptr parent =
+             static_cast<directory *>(up->file().get())
+                 ->entries()
+                 .at("..");
+         if (parent == nullptr || parent == up)
+            break;
+         up = parent;
+      }
+
+   dir into = to->entries();
+   const inode_ptr *existing = into.get(to_name);
+   if (existing != nullptr)
    {
-      stringstream buffer;
-      for (string iter : oldpath)
-         buffer << iter << "/";
-      fn_cd(state, vector<string>{"cd"});
-      fn_cd(state, vector<string>{"cd", buffer.str()});
+      if (*existing == node)
+         return;
+      if ((*existing)->type() == file_type::DIRECTORY_TYPE ||
+          node->type() == file_type::DIRECTORY_TYPE)
+         throw file_error("mv: " + words[2] + ": File exists");
+      to->remove(to_name);
    }
+   to->link(to_name, from->unlink(from_name));
 }
 
 void fn_prompt(inode_state &state, const wordvec &words)
@@ -339,12 +661,7 @@ void fn_pwd(inode_state &state, const wordvec &words)
 {
    DEBUGF('c', state);
    DEBUGF('c', words);
-   // cout << state.path()->size() << endl;
-   cout << "/"
-        << ((state.path()->size() > 0)
-                ? static_cast<string>(state.path()->back())
-                : "")
-        << endl;
+   state.out() << state.path() << endl;
 }
 
 void fn_rm(inode_state &state, const wordvec &words)
@@ -355,30 +672,17 @@ void fn_rm(inode_state &state, const wordvec &words)
       return;
    for (string view : vector<string>(words.cbegin() + 1, words.cend()))
    {
-      wordvec dirs = split(view, "/");
-      string del = dirs.back();
-      dirs.pop_back();
-      stringstream prebuff;
-      prebuff << ".";
-      for (string iter : dirs)
-         prebuff << "/" << iter;
-      wordvec oldpath = vector<string>(*state.path());
-      fn_cd(state, vector<string>{"cd", prebuff.str()});
-      if (state.files().count(del) == 0)
+      string del;
+      inode_ptr where = state.resolve_parent(view, del);
+      dir files = static_cast<directory *>(where->file().get())
+                      ->entries();
+      if (files.count(del) == 0)
          throw file_error("rm: " + del +
                           ": Is not a file or directory");
-      if (
-          state.files()[del].get()->type() ==
-              file_type::DIRECTORY_TYPE &&
-          state.files()[del].get()->file()->size() > 2)
+      if (files.at(del)->type() == file_type::DIRECTORY_TYPE &&
+          files.at(del)->file()->size() > 2)
          return;
-      state.cur().get()->file()->remove(del);
-
-      stringstream buffer;
-      for (string iter : oldpath)
-         buffer << iter << "/";
-      fn_cd(state, vector<string>{"cd"});
-      fn_cd(state, vector<string>{"cd", buffer.str()});
+      where->file()->remove(del);
    }
 }
 
@@ -390,20 +694,32 @@ void fn_rmr(inode_state &state, const wordvec &words)
       return;
    for (string view : vector<string>(words.cbegin() + 1, words.cend()))
    {
-      wordvec dirs = split(view, "/");
-      string del = dirs.back();
-      wordvec oldpath = vector<string>(*state.path());
-      fn_cd(state, vector<string>{"cd", view});
-      static_cast<directory *>(state.cur()->file().get())
-          ->rmr(state.cur());
-      fn_cd(state, vector<string>{"cd", ".."});
-      static_cast<directory *>(state.cur()->file().get())
-          ->remove(del);
-
-      stringstream buffer;
-      buffer << ".";
-      for (string iter : oldpath)
-         buffer << "/" << iter;
-      fn_cd(state, vector<string>{"cd", buffer.str()});
+      if (split(view, "/").size() == 0)
+         throw file_error("rmr: " + view + ": cannot remove root");
+      string del;
+      directory *where = static_cast<directory *>(
+          state.resolve_parent(view, del)->file().get());
+      if (where->entries().count(del) == 0)
+         throw file_error("rmr: " + del +
+                          ": Is not a file or directory");
+      where->rmr(del);
    }
 }
+
+void fn_rollback(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() > 1)
+      throw command_error("rollback: usage: rollback");
+   state.rollback();
+}
+
+void fn_save(inode_state &state, const wordvec &words)
+{
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+   if (words.size() != static_cast<size_t>(2))
+      throw command_error("save: usage: save imagefile");
+   save_image(state, words[1]);
+}
@@ -25,21 +25,72 @@ class command_error: public runtime_error {
 
 // execution functions -
 
+void fn_begin  (inode_state& state, const wordvec& words);
 void fn_cat    (inode_state& state, const wordvec& words);
 void fn_cd     (inode_state& state, const wordvec& words);
+void fn_commit (inode_state& state, const wordvec& words);
+void fn_df     (inode_state& state, const wordvec& words);
+void fn_du     (inode_state& state, const wordvec& words);
 void fn_echo   (inode_state& state, const wordvec& words);
 void fn_exit   (inode_state& state, const wordvec& words);
+void fn_find   (inode_state& state, const wordvec& words);
+void fn_grep   (inode_state& state, const wordvec& words);
+void fn_ln     (inode_state& state, const wordvec& words);
 void fn_ls     (inode_state& state, const wordvec& words);
+void fn_load   (inode_state& state, const wordvec& words);
 void fn_lsr    (inode_state& state, const wordvec& words);
 void fn_make   (inode_state& state, const wordvec& words);
 void fn_mkdir  (inode_state& state, const wordvec& words);
+void fn_mv     (inode_state& state, const wordvec& words);
 void fn_prompt (inode_state& state, const wordvec& words);
 void fn_pwd    (inode_state& state, const wordvec& words);
 void fn_rm     (inode_state& state, const wordvec& words);
 void fn_rmr    (inode_state& state, const wordvec& words);
+void fn_rollback (inode_state& state, const wordvec& words);
+void fn_save   (inode_state& state, const wordvec& words);
 
 command_fn find_command_fn (const string& command);
 
+// command_writes -
+//    True if the command may change the tree rather than just the
+//    state of the session running it.
+
+bool command_writes (const string& command);
+
+// class pipeline -
+//    A command line parsed into stages separated by |, each with its
+//    command already looked up, and an optional file to write the
+//    output into, named after >.  The operators must stand as words
+//    of their own.  Only make and cat read their input.
+// ctor -
+//    Parses the line.  A blank line or comment gives no stages.
+//    Throws command_error for an unknown command or an operator out
+//    of place.
+// empty -
+//    True if there is nothing to run.
+// writes -
+//    True if any stage may change the tree, or the output goes to a
+//    file.
+// run -
+//    Runs the stages in order.  Each stage but the last writes into
+//    a file_sink whose body becomes the input of the next.  The last
+//    writes to the output of the state, or into the named file.
+
+class pipeline {
+   private:
+      struct stage {
+         command_fn fn;
+         wordvec words;
+      };
+      vector<stage> stages;
+      string target;
+   public:
+      explicit pipeline (const string& line);
+      bool empty() const;
+      bool writes() const;
+      void run (inode_state& state) const;
+};
+
 // exit_status_message -
 //    Prints an exit message and returns the exit status, as recorded
 //    by any of the functions.
@@ -1,5 +1,8 @@
 // $Id: file_sys.cpp,v 1.6 2018-06-27 14:44:57-07 - - $
 
+#include <algorithm>
+#include <cstring>
+#include <fnmatch.h>
 #include <iostream>
 #include <iomanip>
 #include <stdexcept>
@@ -11,6 +14,14 @@ using namespace std;
 #include "file_sys.h"
 
 int inode::next_inode_nr{1};
+vector<int> inode::free_inode_nrs;
+mutex inode::inode_nr_lock;
+atomic<int> inode::numbering{0};
+map<string, unordered_set<directory *>> name_index::names;
+mutex name_index::lock;
+atomic<size_t> directory::deferred_count{0};
+atomic<uint64_t> directory::renames{1};
+mutex directory::load_lock;
 
 struct file_type_hash
 {
@@ -25,16 +36,64 @@ ostream &operator<<(ostream &out, file_type type)
    static unordered_map<file_type, string, file_type_hash> hash{
        {file_type::PLAIN_TYPE, "PLAIN_TYPE"},
        {file_type::DIRECTORY_TYPE, "DIRECTORY_TYPE"},
+       {file_type::SYMLINK_TYPE, "SYMLINK_TYPE"},
    };
    return out << hash[type];
 }
 
+usage operator+(const usage &left, const usage &right)
+{
+   return {left.bytes + right.bytes, left.inodes + right.inodes,
+           left.heap + right.heap};
+}
+
+usage operator-(const usage &left, const usage &right)
+{
+   return {left.bytes - right.bytes, left.inodes - right.inodes,
+           left.heap - right.heap};
+}
+
+// The characters that separate words in a file body.
+
+static const char white_space[] = " \t\n\v\f\r";
+
+// Heap taken by the objects behind each kind of inode, counting one
+// version of its contents.  Each object shares its pooled block with
+// the control block that holds its reference counts, which costs
+// about two more words.
+
+static constexpr int64_t shared_overhead = 2 * sizeof(void *);
+static constexpr int64_t file_heap =
+    sizeof(inode) + sizeof(plain_file) + sizeof(file_data_ptr) +
+    2 * shared_overhead;
+static constexpr int64_t dir_heap =
+    sizeof(inode) + sizeof(directory) + sizeof(dir) +
+    2 * shared_overhead;
+static constexpr int64_t link_heap =
+    sizeof(inode) + sizeof(symbolic_link) + 2 * shared_overhead;
+
+// string_heap -
+//    Heap held by a string beyond the string itself, which is none
+//    for short strings kept inside it.
+
+static int64_t string_heap(const string &text)
+{
+   if (text.capacity() > string().capacity())
+      return text.capacity() + 1;
+   return 0;
+}
+
 inode_state::inode_state()
 {
    DEBUGF('i', "root = "
                    << root << ", cwd = " << cwd
                    << ", prompt = \"" << prompt() << "\"");
-   filepath = wordvec();
+}
+
+inode_state::~inode_state()
+{
+   if (txn != nullptr)
+      rollback();
 }
 
 const string &inode_state::prompt() const
@@ -47,6 +106,17 @@ void inode_state::setprompt(const string p)
    prompt_ = p;
 }
 
+ostream &inode_state::out() { return *out_; }
+
+void inode_state::setout(ostream &newout) { out_ = &newout; }
+
+file_data_ptr inode_state::input() const { return in_; }
+
+void inode_state::setinput(file_data_ptr newinput)
+{
+   in_ = move(newinput);
+}
+
 inode_ptr inode_state::cur()
 {
    return cwd;
@@ -54,12 +124,15 @@ inode_ptr inode_state::cur()
 
 dir inode_state::files()
 {
-   return (*(static_cast<dir *>(cwd->file()->get())));
+   return static_cast<directory *>(cwd->file().get())->entries();
 }
 
 inode_ptr inode_state::top() { return root; }
 
-wordvec *inode_state::path() { return &filepath; }
+string inode_state::path()
+{
+   return static_cast<directory *>(cwd->file().get())->path();
+}
 
 void inode_state::set(inode_ptr newdir)
 {
@@ -68,6 +141,94 @@ void inode_state::set(inode_ptr newdir)
       root = newdir;
 }
 
+void inode_state::mount(inode_ptr newroot)
+{
+   root = newroot;
+   cwd = newroot;
+}
+
+inode_ptr inode_state::resolve(const string &path, bool follow)
+{
+   inode_ptr node = path.size() > 0 && path[0] == '/' ? root : cwd;
+   // The names still to follow, the next one last, so that a link
+   // pushes the names of its target in its place.
+   wordvec names = split(path, "/");
+   reverse(names.begin(), names.end());
+   int hops = 0;
+   while (not names.empty())
+   {
+      string name = move(names.back());
+      names.pop_back();
+      if (node->type() != file_type::DIRECTORY_TYPE)
+         throw file_error(path + ": Not a directory");
+      dir entries =
+          static_cast<directory *>(node->file().get())->entries();
+      const inode_ptr *found = entries.get(name);
+      if (found == nullptr)
+         throw file_error(path + ": No such file or directory");
+      if ((*found)->type() != file_type::SYMLINK_TYPE ||
+          (names.empty() && not follow))
+      {
+         node = *found;
+         continue;
+      }
+      if (++hops > symlink_hops)
+         throw file_error(path + ": Too many levels of symbolic links");
+      const string &target =
+          static_cast<symbolic_link *>((*found)->file().get())
+              ->target();
+      wordvec more = split(target, "/");
+      names.insert(names.end(), more.rbegin(), more.rend());
+      if (target.size() > 0 && target[0] == '/')
+         node = root;
+   }
+   return node;
+}
+
+inode_ptr inode_state::resolve_parent(const string &path, string &name)
+{
+   size_t end = path.find_last_not_of('/');
+   if (end == string::npos)
+      throw file_error(path + ": No such file or directory");
+   size_t slash = path.find_last_of('/', end);
+   name = path.substr(slash + 1, end - slash);
+   string where = slash == string::npos ? "."
+                  : slash == 0          ? "/"
+                                        : path.substr(0, slash);
+   inode_ptr parent = resolve(where);
+   if (parent->type() != file_type::DIRECTORY_TYPE)
+      throw file_error(path + ": Not a directory");
+   return parent;
+}
+
+void inode_state::begin()
+{
+   if (txn != nullptr)
+      throw file_error("transaction already open");
+   txn = make_unique<journal>();
+   journal::activate(txn.get());
+}
+
+void inode_state::commit()
+{
+   if (txn == nullptr)
+      throw file_error("no transaction open");
+   journal::activate(nullptr);
+   txn->commit();
+   txn.reset();
+}
+
+void inode_state::rollback()
+{
+   if (txn == nullptr)
+      throw file_error("no transaction open");
+   journal::activate(nullptr);
+   txn->rollback();
+   txn.reset();
+}
+
+bool inode_state::in_transaction() const { return txn != nullptr; }
+
 ostream &
 operator<<(ostream &out, const inode_state &state)
 {
@@ -76,21 +237,55 @@ operator<<(ostream &out, const inode_state &state)
    return out;
 }
 
-inode::inode(file_type type) : inode_nr(next_inode_nr++)
+int inode::take_inode_nr()
+{
+   lock_guard<mutex> guard(inode_nr_lock);
+   if (free_inode_nrs.empty())
+      return next_inode_nr++;
+   int nr = free_inode_nrs.back();
+   free_inode_nrs.pop_back();
+   return nr;
+}
+
+inode::inode(file_type type) : inode(type, take_inode_nr()) {}
+
+inode::inode(file_type type, int nr)
+    : inode_nr(nr), generation(numbering), ftype(type)
 {
-   ftype = type;
    switch (type)
    {
    case file_type::PLAIN_TYPE:
-      contents = make_shared<plain_file>();
+      contents = allocate_shared<plain_file>(
+          pool_allocator<plain_file>());
       break;
    case file_type::DIRECTORY_TYPE:
-      contents = make_shared<directory>();
+      contents = allocate_shared<directory>(
+          pool_allocator<directory>());
+      break;
+   case file_type::SYMLINK_TYPE:
+      contents = allocate_shared<symbolic_link>(
+          pool_allocator<symbolic_link>());
       break;
    }
    DEBUGF('i', "inode " << inode_nr << ", type = " << type);
 }
 
+void inode::reset_inode_nrs(int next_nr, vector<int> free_nrs)
+{
+   lock_guard<mutex> guard(inode_nr_lock);
+   ++numbering;
+   next_inode_nr = next_nr;
+   free_inode_nrs = move(free_nrs);
+}
+
+inode::~inode()
+{
+   DEBUGF('i', "free inode " << inode_nr);
+   lock_guard<mutex> guard(inode_nr_lock);
+   if (generation == numbering)
+      free_inode_nrs.push_back(inode_nr);
+}
+
 int inode::get_inode_nr() const
 {
    DEBUGF('i', "inode = " << inode_nr);
@@ -101,29 +296,186 @@ base_file_ptr inode::file() { return contents; }
 
 file_type inode::type() { return ftype; }
 
+int inode::links() const { return link_count; }
+
+vector<directory *> inode::parents() const
+{
+   vector<directory *> all;
+   if (first_parent != nullptr)
+      all.push_back(first_parent);
+   all.insert(all.end(), other_parents.cbegin(), other_parents.cend());
+   return all;
+}
+
+void inode::link(directory *parent, const string &name)
+{
+   if (first_parent == nullptr)
+      first_parent = parent;
+   else
+      other_parents.push_back(parent);
+   ++link_count;
+   if (ftype == file_type::DIRECTORY_TYPE)
+      static_cast<directory *>(contents.get())->named(parent, name);
+   if (journal *log = journal::active())
+      log->linked(this, parent, name, true);
+}
+
+void inode::unlink(directory *parent, const string &name)
+{
+   if (first_parent == parent)
+   {
+      first_parent = nullptr;
+      if (not other_parents.empty())
+      {
+         first_parent = other_parents.back();
+         other_parents.pop_back();
+      }
+   }
+   else
+   {
+      auto found = find(other_parents.begin(), other_parents.end(),
+                        parent);
+      if (found == other_parents.end())
+         return;
+      other_parents.erase(found);
+   }
+   --link_count;
+   if (journal *log = journal::active())
+      log->linked(this, parent, name, false);
+}
+
 file_error::file_error(const string &what)
     : runtime_error(what) {}
 
+file_data::file_data(word_range words)
+{
+   size_t length = 0;
+   for (auto itor = words.first; itor != words.second; ++itor)
+      length += itor->size() + 1;
+   bytes.reserve(length);
+   for (auto itor = words.first; itor != words.second; ++itor)
+   {
+      if (itor != words.first)
+         bytes += ' ';
+      offsets.push_back(bytes.size());
+      bytes += *itor;
+   }
+   bytes_view = bytes;
+   word_offsets = offsets.data();
+   word_count = offsets.size();
+}
+
+file_data::file_data(string bytes_, vector<uint64_t> offsets_)
+    : bytes(move(bytes_)), offsets(move(offsets_)),
+      bytes_view(bytes), word_offsets(offsets.data()),
+      word_count(offsets.size()) {}
+
+file_data::file_data(shared_ptr<const void> backing_,
+                     string_view text_, const uint64_t *offsets_,
+                     size_t count)
+    : backing(move(backing_)), bytes_view(text_),
+      word_offsets(offsets_), word_count(count) {}
+
+size_t file_data::size() const { return bytes_view.size(); }
+
+size_t file_data::words() const { return word_count; }
+
+string_view file_data::word(size_t index) const
+{
+   if (index >= word_count)
+      throw out_of_range("file_data::word");
+   size_t start = word_offsets[index];
+   size_t limit = index + 1 < word_count ? word_offsets[index + 1]
+                                         : bytes_view.size();
+   size_t end = min(bytes_view.find_first_of(white_space, start),
+                    limit);
+   return bytes_view.substr(start, end - start);
+}
+
+string_view file_data::text() const { return bytes_view; }
+
+size_t file_data::heap() const
+{
+   return sizeof(file_data) + shared_overhead + bytes.size() +
+          offsets.size() * sizeof(uint64_t);
+}
+
+file_data_ptr file_data::empty_data()
+{
+   static const file_data_ptr empty = make_shared<const file_data>();
+   return empty;
+}
+
+ostream &operator<<(ostream &out, const file_data &data)
+{
+   return out << data.text();
+}
+
+void file_sink::append(const char *text, size_t count)
+{
+   for (size_t index = 0; index < count; ++index)
+   {
+      bool space = strchr(white_space, text[index]) != nullptr;
+      if (not space && not in_word)
+         offsets.push_back(bytes.size() + index);
+      in_word = not space;
+   }
+   bytes.append(text, count);
+}
+
+file_sink::int_type file_sink::overflow(int_type ch)
+{
+   if (not traits_type::eq_int_type(ch, traits_type::eof()))
+   {
+      char byte = traits_type::to_char_type(ch);
+      append(&byte, 1);
+   }
+   return traits_type::not_eof(ch);
+}
+
+streamsize file_sink::xsputn(const char *text, streamsize count)
+{
+   append(text, count);
+   return count;
+}
+
+file_data_ptr file_sink::take()
+{
+   file_data_ptr body =
+       make_shared<file_data>(move(bytes), move(offsets));
+   bytes.clear();
+   offsets.clear();
+   in_word = false;
+   return body;
+}
+
 size_t plain_file::size() const
 {
-   size_t size = data.size() > 0 ? data.size() - 1 : 0;
-   for (string iter : data)
-      for (auto i : iter)
-         size++;
+   size_t size = data.read()->size();
    DEBUGF('i', "size = " << size);
    return size;
 }
 
-const wordvec &plain_file::readfile() const
+usage plain_file::used() const
+{
+   file_data_ptr body = data.read();
+   return {static_cast<int64_t>(body->size()), 1,
+           file_heap + static_cast<int64_t>(body->heap())};
+}
+
+file_data_ptr plain_file::readfile() const
 {
-   DEBUGF('i', data);
-   return data;
+   file_data_ptr current = data.read();
+   DEBUGF('i', *current);
+   return current;
 }
 
-void plain_file::writefile(const wordvec &words)
+void plain_file::writefile(file_data_ptr newdata)
 {
-   data = wordvec(words);
-   DEBUGF('i', words);
+   DEBUGF('i', *newdata);
+   if (journal *log = journal::active())
+      log->save_body(this, data.read());
+   data.store(move(newdata));
 }
 
 void plain_file::remove(const string &)
@@ -139,61 +491,423 @@ inode_ptr plain_file::mkfile(const string &)
    throw file_error("is a plain file");
 }
 
-void *plain_file::get() { return &data; }
+void symbolic_link::init(const string &target_) { path = target_; }
 
-directory::directory()
+const string &symbolic_link::target() const { return path; }
+
+size_t symbolic_link::size() const { return path.size(); }
+
+usage symbolic_link::used() const
+{
+   return {static_cast<int64_t>(path.size()), 1,
+           link_heap + string_heap(path)};
+}
+
+file_data_ptr symbolic_link::readfile() const
+{
+   throw file_error("is a symbolic link");
+}
+void symbolic_link::writefile(file_data_ptr)
+{
+   throw file_error("is a symbolic link");
+}
+void symbolic_link::remove(const string &)
+{
+   throw file_error("is a symbolic link");
+}
+inode_ptr symbolic_link::mkdir(const string &)
+{
+   throw file_error("is a symbolic link");
+}
+inode_ptr symbolic_link::mkfile(const string &)
+{
+   throw file_error("is a symbolic link");
+}
+
+void name_index::add(const string &name, directory *parent)
 {
-   dirents = dir();
-   dirents.emplace(".", nullptr);
-   dirents.emplace("..", nullptr);
+   lock_guard<mutex> guard(lock);
+   if (not names[name].insert(parent).second)
+      return;
+   if (journal *log = journal::active())
+      log->indexed(name, parent, true);
 }
 
+void name_index::remove(const string &name, directory *parent)
+{
+   lock_guard<mutex> guard(lock);
+   auto found = names.find(name);
+   if (found == names.end())
+      return;
+   if (found->second.erase(parent) == 0)
+      return;
+   if (found->second.empty())
+      names.erase(found);
+   if (journal *log = journal::active())
+      log->indexed(name, parent, false);
+}
+
+vector<pair<inode_ptr, string>> name_index::match(const string &glob)
+{
+   string prefix = glob.substr(0, glob.find_first_of("*?[\\"));
+   vector<pair<inode_ptr, string>> matches;
+   lock_guard<mutex> guard(lock);
+   for (auto itor = names.lower_bound(prefix);
+        itor != names.end() &&
+        itor->first.compare(0, prefix.size(), prefix) == 0;
+        ++itor)
+   {
+      if (fnmatch(glob.c_str(), itor->first.c_str(), 0) != 0)
+         continue;
+      for (directory *parent : itor->second)
+         matches.emplace_back(parent->self(), itor->first);
+   }
+   return matches;
+}
+
+static thread_local journal *active_journal{nullptr};
+
+journal::suspend::suspend() : saved(active_journal)
+{
+   active_journal = nullptr;
+}
+
+journal::suspend::~suspend() { active_journal = saved; }
+
+journal *journal::active() { return active_journal; }
+
+void journal::activate(journal *log) { active_journal = log; }
+
+void journal::save_entries(directory *where, dir old)
+{
+   if (not entries_saved.insert(where).second)
+      return;
+   base_file_ptr hold = where->shared_from_this();
+   undo.push_back([hold, where, old] { where->publish(old); });
+}
+
+void journal::save_total(directory *where, usage old)
+{
+   if (not totals_saved.insert(where).second)
+      return;
+   base_file_ptr hold = where->shared_from_this();
+   undo.push_back([hold, where, old] { where->set_total(old); });
+}
+
+void journal::save_body(plain_file *file, file_data_ptr old)
+{
+   if (not bodies_saved.insert(file).second)
+      return;
+   base_file_ptr hold = file->shared_from_this();
+   undo.push_back([hold, file, old] { file->writefile(old); });
+}
+
+void journal::indexed(const string &name, directory *parent,
+                      bool added)
+{
+   base_file_ptr hold = parent->shared_from_this();
+   if (added)
+      undo.push_back([hold, name, parent] {
+         name_index::remove(name, parent);
+      });
+   else
+      undo.push_back([hold, name, parent] {
+         name_index::add(name, parent);
+      });
+}
+
+void journal::linked(inode *node, directory *parent,
+                     const string &name, bool added)
+{
+   inode_ptr held = node->shared_from_this();
+   base_file_ptr hold = parent->shared_from_this();
+   if (added)
+      undo.push_back([held, hold, parent, name] {
+         held->unlink(parent, name);
+      });
+   else
+      undo.push_back([held, hold, parent, name] {
+         held->link(parent, name);
+      });
+}
+
+void journal::created(inode_ptr newdir)
+{
+   created_dirs.push_back(move(newdir));
+}
+
+void journal::unlinked(inode_ptr top)
+{
+   unlinked_trees.push_back(move(top));
+}
+
+void journal::commit()
+{
+   DEBUGF('i', "commit " << undo.size() << " changes");
+   undo.clear();
+   created_dirs.clear();
+   for (inode_ptr &top : unlinked_trees)
+      directory::destroy(move(top));
+   unlinked_trees.clear();
+}
+
+void journal::rollback()
+{
+   DEBUGF('i', "roll back " << undo.size() << " changes");
+   for (auto itor = undo.rbegin(); itor != undo.rend(); ++itor)
+      (*itor)();
+   undo.clear();
+   unlinked_trees.clear();
+   // None of these are in the tree any more.
+   for (inode_ptr &newdir : created_dirs)
+      directory::destroy(move(newdir));
+   created_dirs.clear();
+}
+
+static dir dot_entries()
+{
+   dir entries;
+   entries.emplace(".", nullptr);
+   entries.emplace("..", nullptr);
+   return entries;
+}
+
+directory::directory()
+    : dirents(dot_entries()),
+      total_heap(dir_heap + entry_heap(".") + entry_heap("..")) {}
+
 void directory::init(inode_ptr parent, inode_ptr cur)
 {
-   dirents[".."] = parent;
-   dirents["."] = cur;
+   dir files = dirents.read();
+   files.assign("..", parent);
+   files.assign(".", cur);
+   publish(move(files));
+}
+
+void directory::defer(shared_ptr<dir_loader> loader_, uint64_t index)
+{
+   if (loader == nullptr)
+      ++deferred_count;
+   loader = move(loader_);
+   loader_index = index;
+}
+
+dir directory::entries()
+{
+   if (deferred_count == 0)
+      return dirents.read();
+   lock_guard<mutex> guard(load_lock);
+   dir files = dirents.read();
+   if (loader != nullptr)
+   {
+      journal::suspend quiet;
+      loader->load(loader_index, files.at("."), files);
+      loader.reset();
+      --deferred_count;
+      for (const auto &entry : files)
+         if (entry.first != "." && entry.first != "..")
+         {
+            name_index::add(entry.first, this);
+            entry.second->link(this, entry.first);
+         }
+      publish(files);
+      charge(count() - used());
+   }
+   return files;
+}
+
+void directory::publish(dir newentries)
+{
+   if (journal *log = journal::active())
+      log->save_entries(this, dirents.read());
+   dirents.store(move(newentries));
+}
+
+inode_ptr directory::self() const
+{
+   const inode_ptr *dot = dirents.read().get(".");
+   return dot == nullptr ? nullptr : *dot;
+}
+
+string directory::path()
+{
+   uint64_t now = renames;
+   {
+      lock_guard<mutex> guard(path_lock);
+      if (path_generation == now)
+         return cached_path;
+   }
+   // Walk up by dotdot for the names and the latest move above.
+   vector<string> names;
+   uint64_t latest = 0;
+   inode_ptr hold;
+   for (directory *where = this;;)
+   {
+      dir files = where->dirents.read();
+      const inode_ptr *self = files.get(".");
+      const inode_ptr *parent = files.get("..");
+      if (self == nullptr || parent == nullptr || *parent == nullptr)
+      {
+         // Destroyed by rmr, here or above.
+         lock_guard<mutex> guard(path_lock);
+         return cached_path.empty() ? "/" : cached_path;
+      }
+      latest = max(latest, where->moved.load());
+      if (*parent == *self)
+         break;
+      names.push_back(where->name());
+      hold = *parent;
+      where = static_cast<directory *>(hold->file().get());
+   }
+   lock_guard<mutex> guard(path_lock);
+   if (cached_path.empty() || path_moved != latest)
+   {
+      string result;
+      for (auto name = names.crbegin(); name != names.crend(); ++name)
+         result += "/" + *name;
+      cached_path = result.empty() ? "/" : result;
+      path_moved = latest;
+   }
+   path_generation = now;
+   return cached_path;
+}
+
+string directory::name()
+{
+   lock_guard<mutex> guard(path_lock);
+   return entry_name;
+}
+
+void directory::named(const directory *parent, const string &name)
+{
+   lock_guard<mutex> guard(path_lock);
+   bool moving = entry_parent != nullptr &&
+                 (entry_parent != parent || entry_name != name);
+   entry_parent = parent;
+   entry_name = name;
+   if (moving)
+      moved = ++renames;
+}
+
+usage directory::used() const
+{
+   return {total_bytes, total_inodes, total_heap};
+}
+
+usage directory::count()
+{
+   usage counted{0, 1, dir_heap};
+   for (const auto &entry : dirents.read())
+   {
+      counted.heap += entry_heap(entry.first);
+      if (entry.first != "." && entry.first != "..")
+         counted = counted + entry.second->file()->used();
+   }
+   return counted;
+}
+
+void directory::set_total(const usage &total)
+{
+   total_bytes = total.bytes;
+   total_inodes = total.inodes;
+   total_heap = total.heap;
+}
+
+void directory::charge(const usage &delta)
+{
+   inode_ptr hold;
+   journal *log = journal::active();
+   for (directory *where = this;;)
+   {
+      if (log != nullptr)
+         log->save_total(where, where->used());
+      where->total_bytes += delta.bytes;
+      where->total_inodes += delta.inodes;
+      where->total_heap += delta.heap;
+      dir files = where->dirents.read();
+      const inode_ptr *self = files.get(".");
+      const inode_ptr *parent = files.get("..");
+      if (self == nullptr || parent == nullptr ||
+          *parent == nullptr || *parent == *self ||
+          (*self)->links() == 0)
+         break;
+      hold = *parent;
+      where = static_cast<directory *>(hold->file().get());
+   }
+}
+
+int64_t directory::entry_heap(const string &name)
+{
+   return dir::node_size() + shared_overhead + string_heap(name);
+}
+
+size_t directory::deferred() { return deferred_count; }
+
+void directory::load_all(inode_ptr top)
+{
+   vector<inode_ptr> pending{top};
+   while (not pending.empty() && deferred_count > 0)
+   {
+      inode_ptr node = move(pending.back());
+      pending.pop_back();
+      if (node->type() != file_type::DIRECTORY_TYPE)
+         continue;
+      for (const auto &entry :
+           static_cast<directory *>(node->file().get())->entries())
+         if (entry.first != "." && entry.first != "..")
+            pending.push_back(entry.second);
+   }
 }
 
 size_t directory::size() const
 {
-   size_t size = dirents.size();
+   unique_lock<mutex> guard(load_lock, defer_lock);
+   if (deferred_count > 0)
+      guard.lock();
+   size_t size = dirents.read().size();
+   if (loader != nullptr)
+      size += loader->count(loader_index);
    DEBUGF('i', "size = " << size);
    return size;
 }
 
-const wordvec &directory::readfile() const
+file_data_ptr directory::readfile() const
 {
    throw file_error("is a directory");
 }
-void directory::writefile(const wordvec &)
+void directory::writefile(file_data_ptr)
 {
    throw file_error("is a directory");
 }
 
 void directory::remove(const string &filename)
 {
-   if (dirents.count(filename) == 0)
+   dir files = entries();
+   if (files.count(filename) == 0)
       throw file_error(filename + " not found");
-   inode_ptr del = dirents[filename];
+   inode_ptr del = files.at(filename);
    if (del->type() ==
            file_type::DIRECTORY_TYPE &&
        del->file()->size() > 2)
       throw file_error("cannot delete directory: " + filename);
+   unlink(filename);
    if (del->type() == file_type::DIRECTORY_TYPE)
-      static_cast<dir *>(del->file()->get())->clear();
-   else
-      static_cast<wordvec *>(del->file()->get())->clear();
-   dirents.erase(filename);
+      static_cast<directory *>(del->file().get())->publish(dir());
+   else if (del->type() == file_type::PLAIN_TYPE && del->links() == 0)
+      del->file()->writefile(file_data::empty_data());
    DEBUGF('i', filename);
 }
 
 inode_ptr directory::mkdir(const string &dirname)
 {
-   if (dirents.count(dirname) > 0)
+   dir files = entries();
+   if (files.count(dirname) > 0)
       throw file_error(dirname + " already exists");
 
-   inode_ptr newdir = make_shared<inode>(file_type::DIRECTORY_TYPE);
-   dirents.emplace(dirname, newdir);
+   inode_ptr newdir = make_inode(file_type::DIRECTORY_TYPE);
+   if (journal *log = journal::active())
+      log->created(newdir);
+   link(dirname, newdir);
 
    DEBUGF('i', dirname);
    return newdir;
@@ -201,63 +915,153 @@ inode_ptr directory::mkdir(const string &dirname)
 
 inode_ptr directory::mkfile(const string &filename)
 {
-   inode_ptr newfile = make_shared<inode>(file_type::PLAIN_TYPE);
-   dirents.emplace(filename, newfile);
+   dir files = entries();
+   inode_ptr newfile = make_inode(file_type::PLAIN_TYPE);
+   if (files.count(filename) == 0)
+      link(filename, newfile);
 
    DEBUGF('i', filename);
    return newfile;
 }
 
-void *directory::get() { return &dirents; }
+inode_ptr directory::symlink(const string &linkname,
+                             const string &target)
+{
+   inode_ptr newlink = make_inode(file_type::SYMLINK_TYPE);
+   static_cast<symbolic_link *>(newlink->file().get())->init(target);
+   link(linkname, newlink);
+   DEBUGF('i', linkname << " -> " << target);
+   return newlink;
+}
 
-void directory::lsr(inode_ptr show, string relpath)
+void directory::link(const string &name, inode_ptr node)
 {
-   dir files = (*static_cast<dir *>(show->file()->get()));
+   if (name == "." || name == "..")
+      throw file_error(name + ": File exists");
+   dir files = entries();
+   if (files.count(name) > 0)
+      throw file_error(name + ": File exists");
+   if (node->type() == file_type::DIRECTORY_TYPE)
+      static_cast<directory *>(node->file().get())->init(self(), node);
+   files.emplace(name, node);
+   publish(move(files));
+   name_index::add(name, this);
+   node->link(this, name);
+   charge(node->file()->used() + usage{0, 0, entry_heap(name)});
+}
+
+inode_ptr directory::unlink(const string &name)
+{
+   if (name == "." || name == "..")
+      throw file_error("cannot unlink " + name);
+   dir files = entries();
+   const inode_ptr *found = files.get(name);
+   if (found == nullptr)
+      throw file_error(name + " not found");
+   inode_ptr node = *found;
+   usage gone = node->file()->used();
+   gone.heap += entry_heap(name);
+   files.erase(name);
+   publish(move(files));
+   name_index::remove(name, this);
+   node->unlink(this, name);
+   charge(usage() - gone);
+   return node;
+}
+
+void directory::write(const string &filename, file_data_ptr newdata)
+{
+   dir files = entries();
+   const inode_ptr *found = files.get(filename);
+   if (found == nullptr)
+      throw file_error(filename + " not found");
+   write(*found, move(newdata));
+}
+
+void directory::write(const inode_ptr &file, file_data_ptr newdata)
+{
+   base_file_ptr contents = file->file();
+   usage before = contents->used();
+   contents->writefile(move(newdata));
+   usage delta = contents->used() - before;
+   for (directory *parent : file->parents())
+      parent->charge(delta);
+}
+
+void directory::print_entry(ostream &out, const string &name,
+                            const inode_ptr &node)
+{
+   out << setw(6) << node->get_inode_nr() << "  " << setw(6)
+       << node->file()->size() << "  " << name;
+   if (node->type() == file_type::DIRECTORY_TYPE && name != "." &&
+       name != "..")
+      out << "/";
+   else if (node->type() == file_type::SYMLINK_TYPE)
+      out << " -> "
+          << static_cast<symbolic_link *>(node->file().get())->target();
+   out << endl;
+}
+
+void directory::lsr(ostream &out, inode_ptr show, string relpath)
+{
+   dir files =
+       static_cast<directory *>(show->file().get())->entries();
    for (auto iter : files)
-      cout << setw(6)
-           << iter.second->get_inode_nr()
-           << "  " << setw(6) << iter.second->file()->size()
-           << "  " << iter.first
-           << (iter.second->type() == file_type::DIRECTORY_TYPE &&
-                       iter.first != "." &&
-                       iter.first != ".."
-                   ? "/"
-                   : "")
-           << endl;
+      print_entry(out, iter.first, iter.second);
    for (auto iter : files)
    {
       if (iter.first == "." || iter.first == "..")
          continue;
       if (iter.second->type() == file_type::DIRECTORY_TYPE)
       {
-         cout << relpath << "/" << iter.first << ":" << endl;
+         out << relpath << "/" << iter.first << ":" << endl;
          //print full relative path
-         lsr(iter.second, (relpath + "/" + iter.first));
+         lsr(out, iter.second, (relpath + "/" + iter.first));
       }
    }
 }
 
-void directory::rmr(inode_ptr del)
+void directory::rmr(const string &dirname)
 {
-   wordvec deldir = vector<string>();
-   for (auto iter =
-            (*static_cast<dir *>(del->file()->get())).rbegin();
-        iter != (*static_cast<dir *>(del->file()->get())).rend();
-        ++iter)
-      if (!(iter->first == "." || iter->first == ".."))
-         deldir.push_back(iter->first);
+   if (dirname == "." || dirname == "..")
+      throw file_error("cannot remove " + dirname);
+   inode_ptr del = unlink(dirname);
+   if (journal *log = journal::active())
+      log->unlinked(move(del));
+   else
+      destroy(move(del));
+   DEBUGF('i', dirname);
+}
 
-   while (deldir.size() > 0)
+void directory::destroy(inode_ptr top)
+{
+   vector<inode_ptr> pending{top};
+   top.reset();
+   while (not pending.empty())
    {
-      if ((*static_cast<dir *>(del->file()
-                                   ->get()))[deldir[0]]
-                  ->type() ==
-              file_type::DIRECTORY_TYPE &&
-          (*static_cast<dir *>(del->file()->get()))[deldir[0]]
-                  ->file()
-                  ->size() > 0)
-         rmr((*static_cast<dir *>(del->file()->get()))[deldir[0]]);
-      remove(deldir[0].c_str());
-      (*static_cast<dir *>(del->file()->get())).erase(deldir[0]);
+      inode_ptr del = move(pending.back());
+      pending.pop_back();
+      if (del->type() != file_type::DIRECTORY_TYPE)
+         continue;
+      // Deferred entries have no inodes yet, so drop them unloaded.
+      directory *deldir = static_cast<directory *>(del->file().get());
+      {
+         lock_guard<mutex> guard(load_lock);
+         if (deldir->loader != nullptr)
+         {
+            deldir->loader.reset();
+            --deferred_count;
+         }
+      }
+      for (const auto &entry : deldir->dirents.read())
+      {
+         if (entry.first == "." || entry.first == "..")
+            continue;
+         name_index::remove(entry.first, deldir);
+         // Files linked from elsewhere outlive this directory.
+         entry.second->unlink(deldir, entry.first);
+         pending.push_back(entry.second);
+      }
+      deldir->publish(dir());
    }
 }
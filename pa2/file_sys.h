@@ -3,36 +3,92 @@
 #ifndef __INODE_H__
 #define __INODE_H__
 
+#include <atomic>
+#include <cstdint>
 #include <exception>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <streambuf>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 using namespace std;
 
+#include "pmap.h"
+#include "pool.h"
+#include "rcu.h"
 #include "util.h"
 
 // inode_t -
-//    An inode is either a directory or a plain file.
+//    An inode is a directory, a plain file or a symbolic link.
 
 enum class file_type
 {
    PLAIN_TYPE,
-   DIRECTORY_TYPE
+   DIRECTORY_TYPE,
+   SYMLINK_TYPE
 };
 class inode;
 class base_file;
 class plain_file;
+class symbolic_link;
 class directory;
+class file_data;
+class journal;
 using inode_ptr = shared_ptr<inode>;
 using base_file_ptr = shared_ptr<base_file>;
-using dir = map<string, inode_ptr>;
+using file_data_ptr = shared_ptr<const file_data>;
+using dir = pmap<string, inode_ptr>;
 ostream &operator<<(ostream &, file_type);
 
+// struct usage -
+//    What a file or a subtree uses:  the bytes of its file bodies,
+//    its number of inodes, and the heap it holds, counted from the
+//    sizes of the objects allocated for it.  A body shared by two
+//    files counts for each, and so does a file with several links,
+//    once for every link.  Differences are used as deltas.
+
+struct usage
+{
+   int64_t bytes{0};
+   int64_t inodes{0};
+   int64_t heap{0};
+};
+usage operator+(const usage &, const usage &);
+usage operator-(const usage &, const usage &);
+
 // inode_state -
 //    A small convenient class to maintain the state of the simulated
 //    process:  the root (/), the current directory (.), and the
 //    prompt.
+// out, setout -
+//    The stream commands write their output to, cout by default.
+//    Each session of a server has its own.
+// input, setinput -
+//    The body piped into the command, or nullptr if there is none.
+// path -
+//    The absolute path of the current directory, as cached by it.
+// resolve -
+//    Follows a path from the root if it starts with a slash, or else
+//    from the current directory, without changing directory.
+//    Symbolic links are followed wherever they occur, the last
+//    component only if follow is true, up to symlink_hops of them
+//    in all so that cycles end.  Throws file_error if a component is
+//    missing or is not a directory.
+// resolve_parent -
+//    Resolves all but the last component of the path, which must be
+//    a directory, and sets name to the last component.  Throws
+//    file_error if there is no last component.
+// begin, commit, rollback -
+//    Open a transaction, then keep or undo every change made to the
+//    tree since.  The journal is active in the calling thread until
+//    the transaction ends.  Throw file_error if no transaction is
+//    open, or if begin finds one open already.
+// in_transaction -
+//    True between begin and commit or rollback.
 
 class inode_state
 {
@@ -43,28 +99,60 @@ private:
    inode_ptr root{nullptr};
    inode_ptr cwd{nullptr};
    string prompt_{"% "};
-   wordvec filepath;
+   ostream *out_{&cout};
+   file_data_ptr in_;
+   unique_ptr<journal> txn;
 
 public:
    inode_state(const inode_state &) = delete;            // copy ctor
    inode_state &operator=(const inode_state &) = delete; // op=
    inode_state();
+   ~inode_state();
    const string &prompt() const;
    void setprompt(const string p);
+   ostream &out();
+   void setout(ostream &newout);
+   file_data_ptr input() const;
+   void setinput(file_data_ptr newinput);
    inode_ptr cur();
    dir files();
    inode_ptr top();
-   wordvec *path();
+   string path();
    void set(inode_ptr newdir);
-   // inode_ptr navigate(inode_state, const wordvec);
+   void mount(inode_ptr newroot);
+   static constexpr int symlink_hops = 40;
+   inode_ptr resolve(const string &path, bool follow = true);
+   inode_ptr resolve_parent(const string &path, string &name);
+   void begin();
+   void commit();
+   void rollback();
+   bool in_transaction() const;
 };
 
 // class inode -
 // inode ctor -
-//    Create a new inode of the given type.
+//    Create a new inode of the given type.  The second form keeps an
+//    inode number read back from a saved image.
+// inode dtor -
+//    Returns the inode number to the free list.
+// links, parents -
+//    The number of directory entries naming the inode, and the
+//    directories that hold them, once for each entry.  A directory
+//    has one; a plain file or a symbolic link may have several hard
+//    links.  links may be read by any thread, parents only by the
+//    writer.
+// link, unlink -
+//    Record an entry of the given name for the inode made in or
+//    removed from the directory.  Called by the directory.
 // get_inode_nr -
 //    Retrieves the serial number of the inode.  Inode numbers are
-//    allocated in sequence by small integer.
+//    allocated in sequence by small integer, except that the most
+//    recently freed number is reused first.  Numbering is locked,
+//    since inodes may be freed by any session of a server.
+// reset_inode_nrs -
+//    Restarts numbering before a whole tree is replaced.  Inodes
+//    made before the reset do not give their numbers back, as the
+//    old tree may be freed long after the new one is in use.
 // size -
 //    Returns the size of an inode.  For a directory, this is the
 //    number of dirents.  For a text file, the number of characters
@@ -72,27 +160,137 @@ public:
 //    number of words.
 //
 
-class inode
+class inode : public enable_shared_from_this<inode>
 {
    friend class inode_state;
 
 private:
    static int next_inode_nr;
+   static vector<int> free_inode_nrs;
+   static mutex inode_nr_lock;
+   static atomic<int> numbering;
    int inode_nr;
+   int generation;
    base_file_ptr contents;
    file_type ftype;
+   atomic<int> link_count{0};
+   directory *first_parent{nullptr};
+   vector<directory *> other_parents;
+   static int take_inode_nr();
 
 public:
    inode(file_type);
+   inode(file_type, int nr);
+   ~inode();
+   static void reset_inode_nrs(int next_nr, vector<int> free_nrs);
    int get_inode_nr() const;
    base_file_ptr file();
    file_type type();
+   int links() const;
+   vector<directory *> parents() const;
+   void link(directory *parent, const string &name);
+   void unlink(directory *parent, const string &name);
+};
+
+// make_inode -
+//    Makes an inode in the pool for inodes, so that the inode and its
+//    control block take one pooled block instead of a heap block.
+//    The contents of the inode are pooled the same way.
+
+template <typename... Args>
+inode_ptr make_inode(Args &&...args)
+{
+   return allocate_shared<inode>(pool_allocator<inode>(),
+                                 forward<Args>(args)...);
+}
+
+// class file_data -
+// Immutable contents of a plain file.  The words are stored in one
+// contiguous buffer, separated by white space, together with the
+// offset of the start of each word.  Files made from words are
+// separated by single spaces; output collected by a file_sink keeps
+// its own spacing and newlines.  Bodies are shared through
+// file_data_ptr and never modified in place, so making, copying and
+// reading a file only copies a pointer.  The buffer is either owned
+// or a view into memory kept alive by a backing pointer, such as a
+// mapped image.
+// ctor (word_range) -
+//    Joins the words into the buffer.
+// ctor (string, vector) -
+//    Adopts a buffer and word offsets that were built elsewhere.
+// ctor (backing, text, offsets, count) -
+//    Views a buffer and word offsets owned by the backing object.
+// size -
+//    Number of bytes in the buffer, which is also the printed size
+//    of the file.
+// words -
+//    Number of words.
+// word -
+//    A view of the i-th word inside the buffer.
+// text -
+//    A view of the whole buffer.
+// heap -
+//    Bytes of heap held by the body.
+// empty_data -
+//    A shared empty body used by newly created files.
+
+class file_data
+{
+private:
+   string bytes;
+   vector<uint64_t> offsets;
+   shared_ptr<const void> backing;
+   string_view bytes_view;
+   const uint64_t *word_offsets{nullptr};
+   size_t word_count{0};
+
+public:
+   file_data() = default;
+   explicit file_data(word_range words);
+   file_data(string bytes_, vector<uint64_t> offsets_);
+   file_data(shared_ptr<const void> backing_, string_view text_,
+             const uint64_t *offsets_, size_t count);
+   file_data(const file_data &) = delete;
+   file_data &operator=(const file_data &) = delete;
+   size_t size() const;
+   size_t words() const;
+   string_view word(size_t index) const;
+   string_view text() const;
+   size_t heap() const;
+   static file_data_ptr empty_data();
+};
+ostream &operator<<(ostream &, const file_data &);
+
+// class file_sink -
+// A stream buffer that collects output directly into the buffer of
+// a new file body, noting where each word starts as the characters
+// arrive.  Commands write to it through an ostream like to any other
+// output, so piping or redirecting copies no words on the way.
+// take -
+//    Hands over what was written as a file body, and starts over.
+
+class file_sink : public streambuf
+{
+private:
+   string bytes;
+   vector<uint64_t> offsets;
+   bool in_word{false};
+   void append(const char *text, size_t count);
+
+protected:
+   virtual int_type overflow(int_type ch) override;
+   virtual streamsize xsputn(const char *text,
+                             streamsize count) override;
+
+public:
+   file_data_ptr take();
 };
 
 // class base_file -
 // Just a base class at which an inode can point.  No data or
 // functions.  Makes the synthesized members useable only from
-// the derived classes.
+// the derived classes.  Always made shared, so that the journal
+// can hold on to whatever a transaction changes.
 
 class file_error : public runtime_error
 {
@@ -100,7 +298,7 @@ public:
    explicit file_error(const string &what);
 };
 
-class base_file
+class base_file : public enable_shared_from_this<base_file>
 {
 protected:
    base_file() = default;
@@ -110,42 +308,235 @@ public:
    base_file(const base_file &) = delete;
    base_file &operator=(const base_file &) = delete;
    virtual size_t size() const = 0;
-   virtual const wordvec &readfile() const = 0;
-   virtual void writefile(const wordvec &newdata) = 0;
+   virtual usage used() const = 0;
+   virtual file_data_ptr readfile() const = 0;
+   virtual void writefile(file_data_ptr newdata) = 0;
    virtual void remove(const string &filename) = 0;
    virtual inode_ptr mkdir(const string &dirname) = 0;
    virtual inode_ptr mkfile(const string &filename) = 0;
-   virtual void *get() = 0;
 };
 
 // class plain_file -
 // Used to hold data.
 // synthesized default ctor -
-//    Default vector<string> is a an empty vector.
+//    New files share the empty body.
+// used -
+//    The size of the body, one inode, and the heap of both.
 // readfile -
-//    Returns a copy of the contents of the wordvec in the file.
+//    Returns a shared pointer to the body of the file.  Takes no
+//    lock, even while another thread writes the file.
 // writefile -
-//    Replaces the contents of a file with new contents.
+//    Replaces the contents of a file with new contents.  The body
+//    is shared, not copied.
 
 class plain_file : public base_file
 {
 private:
-   wordvec data;
+   rcu_cell<file_data_ptr> data{file_data::empty_data()};
+
+public:
+   virtual size_t size() const override;
+   virtual usage used() const override;
+   virtual file_data_ptr readfile() const override;
+   virtual void writefile(file_data_ptr newdata) override;
+   virtual void remove(const string &filename) override;
+   virtual inode_ptr mkdir(const string &dirname) override;
+   virtual inode_ptr mkfile(const string &filename) override;
+};
+
+// class symbolic_link -
+// Holds the path it refers to, which is followed when the link is
+// resolved.  The path is set once, before the link is put in a
+// directory, and may name nothing.
+// init -
+//    Sets the path.
+// target -
+//    The path, as given to ln -s.
+// size -
+//    The length of the path.
+// used -
+//    The length of the path, one inode, and the heap of both.
+
+class symbolic_link : public base_file
+{
+private:
+   string path;
 
 public:
+   void init(const string &target_);
+   const string &target() const;
    virtual size_t size() const override;
-   virtual const wordvec &readfile() const override;
-   virtual void writefile(const wordvec &newdata) override;
+   virtual usage used() const override;
+   virtual file_data_ptr readfile() const override;
+   virtual void writefile(file_data_ptr newdata) override;
    virtual void remove(const string &filename) override;
    virtual inode_ptr mkdir(const string &dirname) override;
    virtual inode_ptr mkfile(const string &filename) override;
-   virtual void *get() override;
+};
+
+// class name_index -
+// Maps every entry name in the tree to the directories that hold an
+// entry of that name, so that finding files by name does not walk
+// the tree.  The directory class keeps it up to date whenever an
+// entry is added or removed.  Every call takes the index lock, as
+// readers add to it when they load deferred directories.
+// add, remove -
+//    Record or forget the entry name in the directory.
+// match -
+//    All (directory, name) pairs whose name matches the glob.  Only
+//    names starting with the literal prefix of the glob are tried.
+//    The directories are returned as their inodes, taken while the
+//    lock keeps them from being removed.
+
+class name_index
+{
+private:
+   static map<string, unordered_set<directory *>> names;
+   static mutex lock;
+
+public:
+   static void add(const string &name, directory *parent);
+   static void remove(const string &name, directory *parent);
+   static vector<pair<inode_ptr, string>> match(const string &glob);
+};
+
+// class journal -
+// The undo log of an open transaction.  The first time a transaction
+// changes the entries of a directory, the usage it keeps or the body
+// of a file, the journal keeps the old version, which costs only a
+// pointer as versions are shared.  Changes to the name index are
+// logged as their inverse.  So both logging and rolling back take
+// time in proportion to what was changed, not to the size of the
+// tree.  Subtrees removed by rmr are only unlinked, and destroyed
+// when the transaction commits.
+// active -
+//    The journal of the transaction open in this thread, or nullptr.
+// activate -
+//    Makes the journal active in this thread.
+// suspend -
+//    Keeps the journal inactive in this thread for its lifetime, for
+//    changes that are not the caller's, such as loading a directory.
+// save_entries, save_total, save_body -
+//    Keep the old version of each, the first time only.
+// indexed -
+//    Logs that the name was added to or removed from the index.
+// Each change holds what it changed, as a transaction may free a
+// directory or a file that rolling back will put back in the tree.
+// linked -
+//    Logs that an entry for the inode was made in or removed from
+//    the directory, holding both until the transaction ends.
+// created -
+//    Logs a directory made by the transaction, so that rolling back
+//    can break its cycles.
+// unlinked -
+//    Holds a removed subtree until the transaction ends.
+// commit -
+//    Drops the log and destroys the removed subtrees.
+// rollback -
+//    Restores the old versions, newest change first.
+
+class journal
+{
+private:
+   vector<function<void()>> undo;
+   unordered_set<const directory *> entries_saved;
+   unordered_set<const directory *> totals_saved;
+   unordered_set<const plain_file *> bodies_saved;
+   vector<inode_ptr> created_dirs;
+   vector<inode_ptr> unlinked_trees;
+
+public:
+   class suspend
+   {
+   private:
+      journal *saved;
+
+   public:
+      suspend();
+      ~suspend();
+      suspend(const suspend &) = delete;
+      suspend &operator=(const suspend &) = delete;
+   };
+   journal() = default;
+   journal(const journal &) = delete;
+   journal &operator=(const journal &) = delete;
+   static journal *active();
+   static void activate(journal *log);
+   void save_entries(directory *where, dir old);
+   void save_total(directory *where, usage old);
+   void save_body(plain_file *file, file_data_ptr old);
+   void indexed(const string &name, directory *parent, bool added);
+   void linked(inode *node, directory *parent, const string &name,
+               bool added);
+   void created(inode_ptr newdir);
+   void unlinked(inode_ptr top);
+   void commit();
+   void rollback();
+};
+
+// class dir_loader -
+// Supplies the entries of directories whose contents live somewhere
+// else, such as a mapped image, until they are first needed.
+// count -
+//    Number of entries, not counting dot and dotdot.
+// load -
+//    Adds the entries of the directory to a copy of its dirents,
+//    which is then published.  The inode
+//    of the directory itself is passed to become the dotdot of any
+//    subdirectories.
+
+class dir_loader : public enable_shared_from_this<dir_loader>
+{
+public:
+   virtual ~dir_loader() = default;
+   virtual size_t count(uint64_t index) const = 0;
+   virtual void load(uint64_t index, inode_ptr self, dir &entries) = 0;
 };
 
 // class directory -
-// Used to map filenames onto inode pointers.
+// Used to map filenames onto inode pointers.  The map is kept as a
+// sequence of immutable versions:  readers take a snapshot of the
+// current one without locking, and writers publish a new version
+// built from the last, which shares all but the changed path.  Old
+// versions are freed by rcu once no reader can still be using them.
+// Writers must be serialized by the caller.
+// Every directory also keeps the usage of its whole subtree, which
+// each change adds to the directory it is made in and all of the
+// directories above it, so that du and df need not walk the tree.
 // default ctor -
 //    Creates a new map with keys "." and "..".
+// defer -
+//    Leaves the entries other than dot and dotdot to a loader.  They
+//    are added to the map the first time the directory is used, and
+//    until then cost nothing but the pointer to the loader.  Only
+//    for directories no other thread can reach yet, as loaders call
+//    it with the load lock held.
+// entries -
+//    Returns a snapshot of the map, loading the deferred entries
+//    first.  While any directory is deferred, loading is serialized
+//    by one lock so that concurrent readers may trigger it.
+// publish -
+//    Makes the map the current version.
+// self -
+//    The inode of the directory, from its dot entry.
+// path -
+//    The absolute path of the directory, built from the names the
+//    directories above it were linked under.  It is cached until mv
+//    moves a directory.  Then each directory walks up to the root
+//    once more, which costs its depth, but only the ones below the
+//    moved directory build their paths again.  A directory that has
+//    been removed keeps its last path.
+// name -
+//    The name of the entry for this directory, which it keeps after
+//    it is unlinked.  Empty for the root.
+// named -
+//    Records the directory and name of the entry for this one.  If
+//    either differs from before, the directory was moved, and the
+//    paths cached below it are out of date.
+// deferred -
+//    Number of directories whose entries have not been loaded yet.
+// load_all -
+//    Loads every deferred directory below the given one.
 // remove -
 //    Removes the file or subdirectory from the current inode.
 //    Throws an file_error if this is not a directory, the file
@@ -159,25 +550,100 @@ public:
 // mkfile -
 //    Create a new empty text file with the given name.  Error if
 //    a dirent with that name exists.
+// symlink -
+//    Creates a symbolic link to the path.  Error if a dirent with
+//    that name exists.
+// link -
+//    Adds an entry for an existing inode, which is a hard link for a
+//    file.  A directory gets this directory as its dotdot, which is
+//    how mv moves a subtree without touching anything inside it.
+//    Error if a dirent with that name exists.
+// unlink -
+//    Removes the entry and returns its inode, which is not changed
+//    otherwise, for link to put somewhere else.
+// write -
+//    Replaces the body of the named file in this directory, or of
+//    the file, charging every directory that holds a link to it.
+// print_entry -
+//    Prints one line of a listing, as ls and lsr show it.
+// used -
+//    The usage of the subtree, without walking it.
+// count -
+//    Counts the usage of the subtree from the entries and the totals
+//    kept by the subdirectories, in time proportional to the number
+//    of entries.
+// set_total -
+//    Sets the usage of the subtree without charging the directories
+//    above, for trees that are built bottom up or from an image.
+// charge -
+//    Adds a change in usage to this directory and every directory
+//    above it, up to the root or to a directory that is no longer
+//    linked, such as the top of a subtree that rmr has unlinked but
+//    a transaction still holds.
+// entry_heap -
+//    The heap taken by an entry of the given name.
+// rmr -
+//    Removes the named entry and everything below it.
+// destroy -
+//    Tears down a whole subtree in one pass with an explicit stack:
+//    each directory hands its children to the stack and publishes
+//    an empty map, which breaks the dot/dotdot reference cycles so
+//    every inode is freed exactly once and no destructor recurses.
 
 class directory : public base_file
 {
 private:
-   // Must be a map, not unordered_map, so printing is lexicographic
-   dir dirents;
+   // Must be sorted, not unordered, so printing is lexicographic
+   rcu_cell<dir> dirents;
+   shared_ptr<dir_loader> loader;
+   uint64_t loader_index{0};
+   static atomic<size_t> deferred_count;
+   static mutex load_lock;
+   atomic<int64_t> total_bytes{0};
+   atomic<int64_t> total_inodes{1};
+   atomic<int64_t> total_heap{0};
+   mutex path_lock;
+   const directory *entry_parent{nullptr};
+   string entry_name;
+   string cached_path;
+   uint64_t path_generation{0};
+   uint64_t path_moved{0};
+   atomic<uint64_t> moved{0};
+   static atomic<uint64_t> renames;
 
 public:
    directory();
    void init(inode_ptr, inode_ptr);
+   void defer(shared_ptr<dir_loader> loader_, uint64_t index);
+   dir entries();
+   void publish(dir newentries);
+   inode_ptr self() const;
+   string path();
+   string name();
+   void named(const directory *parent, const string &name);
+   static size_t deferred();
+   static void load_all(inode_ptr top);
    virtual size_t size() const override;
-   virtual const wordvec &readfile() const override;
-   virtual void writefile(const wordvec &newdata) override;
+   virtual usage used() const override;
+   virtual file_data_ptr readfile() const override;
+   virtual void writefile(file_data_ptr newdata) override;
    virtual void remove(const string &filename) override;
    virtual inode_ptr mkdir(const string &dirname) override;
    virtual inode_ptr mkfile(const string &filename) override;
-   virtual void *get() override;
-   void lsr(inode_ptr, string);
-   void rmr(inode_ptr);
+   inode_ptr symlink(const string &linkname, const string &target);
+   void link(const string &name, inode_ptr node);
+   inode_ptr unlink(const string &name);
+   void write(const string &filename, file_data_ptr newdata);
+   static void write(const inode_ptr &file, file_data_ptr newdata);
+   static void print_entry(ostream &out, const string &name,
+                           const inode_ptr &node);
+   usage count();
+   void set_total(const usage &total);
+   void charge(const usage &delta);
+   static int64_t entry_heap(const string &name);
+   void lsr(ostream &, inode_ptr, string);
+   void rmr(const string &dirname);
+   static void destroy(inode_ptr top);
 };
 
 #endif
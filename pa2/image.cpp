@@ -0,0 +1,614 @@
+// $Id: image.cpp,v 1.1 2026-10-19 11:10:00-07 - - $
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "debug.h"
+#include "image.h"
+
+static const char image_magic[8] = {'Y', 'S', 'H', 'I',
+                                    'M', 'G', '\0', '\0'};
+static constexpr uint32_t image_version = 3;
+
+static uint64_t align8(uint64_t offset)
+{
+   return (offset + 7) & ~uint64_t{7};
+}
+
+// fits -
+//    True if count items of the given size starting at offset all
+//    lie within length bytes, without overflowing.
+
+static bool fits(uint64_t offset, uint64_t count, uint64_t size,
+                 uint64_t length)
+{
+   if (offset > length)
+      return false;
+   return count <= (length - offset) / size;
+}
+
+image_map::image_map(const string &filename_) : filename(filename_)
+{
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0)
+      throw file_error(filename + ": " + strerror(errno));
+   struct stat stats;
+   if (fstat(fd, &stats) < 0)
+   {
+      int error = errno;
+      close(fd);
+      throw file_error(filename + ": " + strerror(error));
+   }
+   length = stats.st_size;
+   if (length < sizeof(image_header))
+   {
+      close(fd);
+      throw file_error(filename + ": not a yshell image");
+   }
+   void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE,
+                       fd, 0);
+   int error = errno;
+   close(fd);
+   if (mapped == MAP_FAILED)
+      throw file_error(filename + ": " + strerror(error));
+   base = static_cast<const char *>(mapped);
+   try
+   {
+      check_header();
+   }
+   catch (...)
+   {
+      munmap(const_cast<char *>(base), length);
+      throw;
+   }
+   DEBUGF('m', filename << ": " << length << " bytes, "
+                        << header().inode_count << " inodes");
+}
+
+image_map::~image_map()
+{
+   munmap(const_cast<char *>(base), length);
+}
+
+file_error image_map::bad(const string &why) const
+{
+   return file_error(filename + ": bad image: " + why);
+}
+
+void image_map::check_header() const
+{
+   const image_header &head = header();
+   if (memcmp(head.magic, image_magic, sizeof image_magic) != 0)
+      throw file_error(filename + ": not a yshell image");
+   if (head.version != image_version)
+      throw bad("version " + to_string(head.version));
+   if (head.inode_count == 0 ||
+       head.inodes_offset % 8 != 0 || head.words_offset % 8 != 0 ||
+       not fits(head.inodes_offset, head.inode_count,
+                sizeof(image_inode), length) ||
+       not fits(head.words_offset, head.words_count,
+                sizeof(uint64_t), length) ||
+       not fits(head.names_offset, head.names_size, 1, length) ||
+       not fits(head.data_offset, head.data_size, 1, length))
+      throw bad("section out of range");
+   if (head.next_inode_nr < 1)
+      throw bad("inode number");
+   if (entry(0).type !=
+           static_cast<uint32_t>(file_type::DIRECTORY_TYPE) ||
+       entry(0).first_link != 0 || entry(0).link_count != 1)
+      throw bad("root is not a directory");
+}
+
+void image_map::check_children(uint64_t index) const
+{
+   const image_header &head = header();
+   const image_inode &node = entry(index);
+   if (node.first_child <= index ||
+       not fits(node.first_child, node.child_count, 1,
+                head.inode_count))
+      throw bad("directory " + to_string(index));
+   string_view last;
+   uint64_t bytes = 0;
+   uint64_t inodes = 1;
+   auto add = [this, index](uint64_t &total, uint64_t more,
+                            uint64_t limit) {
+      if (more > limit - total)
+         throw bad("usage of directory " + to_string(index));
+      total += more;
+   };
+   for (uint64_t child = node.first_child;
+        child < node.first_child + node.child_count; ++child)
+   {
+      const image_inode &kid = entry(child);
+      if (kid.inode_nr < 1 || kid.inode_nr >= head.next_inode_nr)
+         throw bad("inode number " + to_string(kid.inode_nr));
+      if (not fits(kid.name_offset, kid.name_size, 1,
+                   head.names_size))
+         throw bad("name out of range");
+      string_view kidname = name(kid);
+      if (kidname.empty() || kidname == "." || kidname == ".." ||
+          kidname.find('/') != string_view::npos ||
+          (child > node.first_child && kidname <= last))
+         throw bad("entry name in " + to_string(index));
+      last = kidname;
+      if (kid.link_count < 1 || kid.first_link > child)
+         throw bad("links of " + to_string(child));
+      if (kid.first_link != child)
+      {
+         // Only the name may differ from the first link.
+         const image_inode &first = entry(kid.first_link);
+         if (kid.type ==
+                 static_cast<uint32_t>(file_type::DIRECTORY_TYPE) ||
+             first.first_link != kid.first_link ||
+             first.inode_nr != kid.inode_nr ||
+             first.type != kid.type ||
+             first.link_count != kid.link_count ||
+             first.data_offset != kid.data_offset ||
+             first.data_size != kid.data_size ||
+             first.words_offset != kid.words_offset ||
+             first.words_count != kid.words_count)
+            throw bad("links of " + to_string(child));
+      }
+      switch (static_cast<file_type>(kid.type))
+      {
+      case file_type::DIRECTORY_TYPE:
+         if (kid.link_count != 1)
+            throw bad("links of " + to_string(child));
+         add(bytes, kid.subtree_bytes, node.subtree_bytes);
+         add(inodes, kid.subtree_inodes, node.subtree_inodes);
+         break;
+      case file_type::PLAIN_TYPE:
+      {
+         if (kid.child_count != 0 ||
+             not fits(kid.data_offset, kid.data_size, 1,
+                      head.data_size) ||
+             not fits(kid.words_offset, kid.words_count, 1,
+                      head.words_count))
+            throw bad("file " + to_string(child));
+         const uint64_t *offsets = words(kid);
+         for (uint64_t word = 0; word < kid.words_count; ++word)
+            if (offsets[word] > kid.data_size ||
+                (word > 0 && offsets[word] <= offsets[word - 1]))
+               throw bad("word offsets of " + to_string(child));
+         add(bytes, kid.data_size, node.subtree_bytes);
+         add(inodes, 1, node.subtree_inodes);
+         break;
+      }
+      case file_type::SYMLINK_TYPE:
+         if (kid.child_count != 0 || kid.words_count != 0 ||
+             kid.data_size == 0 ||
+             not fits(kid.data_offset, kid.data_size, 1,
+                      head.data_size))
+            throw bad("symbolic link " + to_string(child));
+         add(bytes, kid.data_size, node.subtree_bytes);
+         add(inodes, 1, node.subtree_inodes);
+         break;
+      default:
+         throw bad("type of " + to_string(child));
+      }
+   }
+   if (bytes != node.subtree_bytes || inodes != node.subtree_inodes)
+      throw bad("usage of directory " + to_string(index));
+}
+
+void image_map::check_tree() const
+{
+   const image_header &head = header();
+   vector<bool> used(head.next_inode_nr);
+   map<uint64_t, uint64_t> links;
+   uint64_t next_child = 1;
+   for (uint64_t index = 0; index < head.inode_count; ++index)
+   {
+      const image_inode &node = entry(index);
+      if (index > 0 && index >= next_child)
+         throw bad("inode " + to_string(index) + " has no parent");
+      if (node.link_count > 1)
+         ++links[node.first_link];
+      if (node.first_link != index)
+         continue;
+      if (node.inode_nr < 1 || node.inode_nr >= head.next_inode_nr ||
+          used[node.inode_nr])
+         throw bad("inode number " + to_string(node.inode_nr));
+      used[node.inode_nr] = true;
+      if (node.type !=
+          static_cast<uint32_t>(file_type::DIRECTORY_TYPE))
+         continue;
+      if (node.first_child != next_child)
+         throw bad("directory " + to_string(index));
+      check_children(index);
+      next_child += node.child_count;
+   }
+   for (const auto &first : links)
+      if (first.second != entry(first.first).link_count)
+         throw bad("links of " + to_string(first.first));
+}
+
+const image_header &image_map::header() const
+{
+   return *reinterpret_cast<const image_header *>(base);
+}
+
+const image_inode &image_map::entry(uint64_t index) const
+{
+   return reinterpret_cast<const image_inode *>(
+       base + header().inodes_offset)[index];
+}
+
+const uint64_t *image_map::words(const image_inode &node) const
+{
+   return reinterpret_cast<const uint64_t *>(
+              base + header().words_offset) +
+          node.words_offset;
+}
+
+string_view image_map::name(const image_inode &node) const
+{
+   return string_view(base + header().names_offset +
+                          node.name_offset,
+                      node.name_size);
+}
+
+string_view image_map::data(const image_inode &node) const
+{
+   return string_view(base + header().data_offset + node.data_offset,
+                      node.data_size);
+}
+
+void save_image(inode_state &state, const string &filename)
+{
+   vector<image_inode> table;
+   vector<uint64_t> words;
+   string names;
+   string data;
+   vector<inode_ptr> order{state.top()};
+   map<inode *, uint64_t> first_links;
+   table.push_back(image_inode{});
+   for (size_t index = 0; index < order.size(); ++index)
+   {
+      inode_ptr node = order[index];
+      table[index].inode_nr = node->get_inode_nr();
+      table[index].type = static_cast<uint32_t>(node->type());
+      table[index].first_link = index;
+      if (node->type() != file_type::DIRECTORY_TYPE &&
+          node->links() > 1)
+      {
+         auto first = first_links.emplace(node.get(), index);
+         if (not first.second)
+         {
+            const image_inode &saved = table[first.first->second];
+            table[index].first_link = first.first->second;
+            table[index].data_offset = saved.data_offset;
+            table[index].data_size = saved.data_size;
+            table[index].words_offset = saved.words_offset;
+            table[index].words_count = saved.words_count;
+            continue;
+         }
+      }
+      if (node->type() == file_type::SYMLINK_TYPE)
+      {
+         const string &target =
+             static_cast<symbolic_link *>(node->file().get())
+                 ->target();
+         table[index].data_offset = data.size();
+         table[index].data_size = target.size();
+         table[index].words_offset = words.size();
+         data += target;
+      }
+      else if (node->type() == file_type::DIRECTORY_TYPE)
+      {
+         table[index].first_child = order.size();
+         for (const auto &dirent :
+              static_cast<directory *>(node->file().get())->entries())
+         {
+            if (dirent.first == "." || dirent.first == "..")
+               continue;
+            image_inode child{};
+            child.name_offset = names.size();
+            child.name_size = dirent.first.size();
+            names += dirent.first;
+            table.push_back(child);
+            order.push_back(dirent.second);
+         }
+         table[index].child_count =
+             order.size() - table[index].first_child;
+      }
+      else
+      {
+         file_data_ptr body = node->file()->readfile();
+         string_view text = body->text();
+         table[index].data_offset = data.size();
+         table[index].data_size = text.size();
+         table[index].words_offset = words.size();
+         table[index].words_count = body->words();
+         for (size_t word = 0; word < body->words(); ++word)
+            words.push_back(body->word(word).data() - text.data());
+         data += text;
+      }
+   }
+
+   vector<uint64_t> link_counts(table.size());
+   for (const image_inode &node : table)
+      ++link_counts[node.first_link];
+   for (image_inode &node : table)
+      node.link_count = link_counts[node.first_link];
+
+   // Children come after their parents, so a pass from the end adds
+   // up every subtree.  A file counts once for each of its links.
+   for (size_t index = table.size(); index-- > 0;)
+   {
+      image_inode &node = table[index];
+      if (node.type != static_cast<uint32_t>(file_type::DIRECTORY_TYPE))
+         continue;
+      node.subtree_inodes = 1;
+      for (uint64_t child = node.first_child;
+           child < node.first_child + node.child_count; ++child)
+      {
+         const image_inode &kid = table[child];
+         if (kid.type ==
+             static_cast<uint32_t>(file_type::DIRECTORY_TYPE))
+         {
+            node.subtree_bytes += kid.subtree_bytes;
+            node.subtree_inodes += kid.subtree_inodes;
+         }
+         else
+         {
+            node.subtree_bytes += kid.data_size;
+            node.subtree_inodes += 1;
+         }
+      }
+   }
+
+   image_header head{};
+   memcpy(head.magic, image_magic, sizeof image_magic);
+   head.version = image_version;
+   int next_nr = 1;
+   for (const image_inode &node : table)
+      next_nr = max(next_nr, node.inode_nr + 1);
+   head.next_inode_nr = next_nr;
+   head.inode_count = table.size();
+   head.inodes_offset = align8(sizeof head);
+   head.words_offset =
+       align8(head.inodes_offset + table.size() * sizeof(image_inode));
+   head.words_count = words.size();
+   head.names_offset =
+       head.words_offset + words.size() * sizeof(uint64_t);
+   head.names_size = names.size();
+   head.data_offset = head.names_offset + names.size();
+   head.data_size = data.size();
+
+   string tempname = filename + ".tmp";
+   ofstream out(tempname, ios::binary | ios::trunc);
+   auto pad_to = [&out](uint64_t offset) {
+      while (static_cast<uint64_t>(out.tellp()) < offset)
+         out.put('\0');
+   };
+   out.write(reinterpret_cast<const char *>(&head), sizeof head);
+   pad_to(head.inodes_offset);
+   out.write(reinterpret_cast<const char *>(table.data()),
+             table.size() * sizeof(image_inode));
+   pad_to(head.words_offset);
+   out.write(reinterpret_cast<const char *>(words.data()),
+             words.size() * sizeof(uint64_t));
+   out.write(names.data(), names.size());
+   out.write(data.data(), data.size());
+   out.close();
+   if (not out)
+   {
+      remove(tempname.c_str());
+      throw file_error(filename + ": write failed");
+   }
+   if (rename(tempname.c_str(), filename.c_str()) < 0)
+   {
+      int error = errno;
+      remove(tempname.c_str());
+      throw file_error(filename + ": " + strerror(error));
+   }
+   DEBUGF('m', filename << ": " << table.size() << " inodes");
+}
+
+void load_image(inode_state &state, const string &filename)
+{
+   image_map image(filename);
+   image.check_tree();
+   const image_header &head = image.header();
+
+   vector<bool> used(head.next_inode_nr);
+   for (uint64_t index = 0; index < head.inode_count; ++index)
+      used[image.entry(index).inode_nr] = true;
+   vector<int> free_nrs;
+   for (int nr = head.next_inode_nr - 1; nr > 0; --nr)
+      if (not used[nr])
+         free_nrs.push_back(nr);
+   inode::reset_inode_nrs(head.next_inode_nr, move(free_nrs));
+
+   vector<inode_ptr> nodes(head.inode_count);
+   nodes[0] = make_inode(file_type::DIRECTORY_TYPE,
+                         image.entry(0).inode_nr);
+   static_cast<directory *>(nodes[0]->file().get())
+       ->init(nodes[0], nodes[0]);
+   for (uint64_t index = 0; index < head.inode_count; ++index)
+   {
+      const image_inode &node = image.entry(index);
+      if (node.first_link != index)
+         continue;
+      if (node.type == static_cast<uint32_t>(file_type::SYMLINK_TYPE))
+      {
+         static_cast<symbolic_link *>(nodes[index]->file().get())
+             ->init(string(image.data(node)));
+         continue;
+      }
+      if (node.type == static_cast<uint32_t>(file_type::PLAIN_TYPE))
+      {
+         const uint64_t *offsets = image.words(node);
+         nodes[index]->file()->writefile(make_shared<file_data>(
+             string(image.data(node)),
+             vector<size_t>(offsets, offsets + node.words_count)));
+         continue;
+      }
+      directory *parent =
+          static_cast<directory *>(nodes[index]->file().get());
+      dir dirents = parent->entries();
+      for (uint64_t child = node.first_child;
+           child < node.first_child + node.child_count; ++child)
+      {
+         const image_inode &kid = image.entry(child);
+         if (kid.first_link != child)
+            nodes[child] = nodes[kid.first_link];
+         else
+            nodes[child] = make_inode(
+                static_cast<file_type>(kid.type), kid.inode_nr);
+         string kidname(image.name(kid));
+         nodes[child]->link(parent, kidname);
+         if (kid.type ==
+             static_cast<uint32_t>(file_type::DIRECTORY_TYPE))
+            static_cast<directory *>(nodes[child]->file().get())
+                ->init(nodes[index], nodes[child]);
+         dirents.emplace(kidname, nodes[child]);
+         name_index::add(kidname, parent);
+      }
+      parent->publish(move(dirents));
+   }
+   for (uint64_t index = head.inode_count; index-- > 0;)
+      if (nodes[index]->type() == file_type::DIRECTORY_TYPE)
+      {
+         directory *where =
+             static_cast<directory *>(nodes[index]->file().get());
+         where->set_total(where->count());
+      }
+
+   inode_ptr old = state.top();
+   state.mount(nodes[0]);
+   nodes.clear();
+   if (old != nullptr)
+      directory::destroy(old);
+   old.reset();
+   DEBUGF('m', filename << ": " << head.inode_count << " inodes");
+}
+
+// mapped_tree -
+//    Loads directories of a mounted image one at a time.  Plain
+//    files view their bytes and word offsets in the mapping, which
+//    stays mapped as long as any of them or any deferred directory
+//    still refers to it.  A file with several links is kept in
+//    linked, under its first link, until all of its links have been
+//    loaded, so that every directory gets the same inode.
+
+class mapped_tree : public dir_loader
+{
+private:
+   shared_ptr<const image_map> image;
+   mutex linked_lock;
+   map<uint64_t, pair<inode_ptr, uint64_t>> linked;
+   inode_ptr make_file(uint64_t index);
+
+public:
+   explicit mapped_tree(shared_ptr<const image_map> image_)
+       : image(move(image_)) {}
+   virtual size_t count(uint64_t index) const override;
+   virtual void load(uint64_t index, inode_ptr self,
+                     dir &entries) override;
+};
+
+size_t mapped_tree::count(uint64_t index) const
+{
+   return image->entry(index).child_count;
+}
+
+// make_file -
+//    The inode of a plain file or symbolic link, made the first time
+//    any of its links is loaded.
+
+inode_ptr mapped_tree::make_file(uint64_t index)
+{
+   const image_inode &kid = image->entry(index);
+   unique_lock<mutex> guard(linked_lock, defer_lock);
+   if (kid.link_count > 1)
+   {
+      guard.lock();
+      auto found = linked.find(kid.first_link);
+      if (found != linked.end())
+      {
+         inode_ptr node = found->second.first;
+         if (--found->second.second == 0)
+            linked.erase(found);
+         return node;
+      }
+   }
+   inode_ptr node =
+       make_inode(static_cast<file_type>(kid.type), kid.inode_nr);
+   if (kid.type == static_cast<uint32_t>(file_type::SYMLINK_TYPE))
+      static_cast<symbolic_link *>(node->file().get())
+          ->init(string(image->data(kid)));
+   else
+      node->file()->writefile(make_shared<file_data>(
+          image, image->data(kid), image->words(kid),
+          kid.words_count));
+   if (kid.link_count > 1)
+      linked.emplace(kid.first_link,
+                     make_pair(node, kid.link_count - 1));
+   return node;
+}
+
+void mapped_tree::load(uint64_t index, inode_ptr self, dir &entries)
+{
+   image->check_children(index);
+   const image_inode &node = image->entry(index);
+   shared_ptr<dir_loader> loader = shared_from_this();
+   for (uint64_t child = node.first_child;
+        child < node.first_child + node.child_count; ++child)
+   {
+      const image_inode &kid = image->entry(child);
+      inode_ptr kidnode;
+      if (kid.type !=
+          static_cast<uint32_t>(file_type::DIRECTORY_TYPE))
+         kidnode = make_file(child);
+      else
+      {
+         kidnode = make_inode(file_type::DIRECTORY_TYPE, kid.inode_nr);
+         directory *kiddir =
+             static_cast<directory *>(kidnode->file().get());
+         kiddir->init(self, kidnode);
+         kiddir->defer(loader, child);
+         kiddir->set_total({static_cast<int64_t>(kid.subtree_bytes),
+                            static_cast<int64_t>(kid.subtree_inodes),
+                            kiddir->used().heap});
+      }
+      entries.emplace(string(image->name(kid)), kidnode);
+   }
+   DEBUGF('m', "loaded " << node.child_count << " entries of "
+                         << index);
+}
+
+void mount_image(inode_state &state, const string &filename)
+{
+   auto image = make_shared<const image_map>(filename);
+   const image_header &head = image->header();
+   inode::reset_inode_nrs(head.next_inode_nr, {});
+   inode_ptr root = make_inode(file_type::DIRECTORY_TYPE,
+                               image->entry(0).inode_nr);
+   directory *rootdir = static_cast<directory *>(root->file().get());
+   rootdir->init(root, root);
+   rootdir->defer(make_shared<mapped_tree>(image), 0);
+   rootdir->set_total(
+       {static_cast<int64_t>(image->entry(0).subtree_bytes),
+        static_cast<int64_t>(image->entry(0).subtree_inodes),
+        rootdir->used().heap});
+
+   inode_ptr old = state.top();
+   state.mount(root);
+   if (old != nullptr)
+      directory::destroy(old);
+   old.reset();
+   DEBUGF('m', filename << ": mounted " << head.inode_count
+                        << " inodes");
+}
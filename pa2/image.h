@@ -0,0 +1,122 @@
+// $Id: image.h,v 1.1 2026-10-19 11:10:00-07 - - $
+
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include <cstdint>
+#include <string>
+using namespace std;
+
+#include "file_sys.h"
+
+// Binary image of an inode tree -
+//    The file is laid out as a header followed by four sections, each
+//    starting on an 8-byte boundary:
+//       inode table   image_inode[inode_count], breadth first, so
+//                     the children of every directory are contiguous
+//                     and sorted by name; entry 0 is the root.
+//       word table    uint64_t offsets of the words of every file.
+//       name pool     entry names, not NUL terminated.
+//       data pool     file bodies, as stored by file_data, and the
+//                     targets of symbolic links.
+//    Dot and dotdot are not stored; they are rebuilt from the table.
+//    Each directory records the bytes and inodes of its subtree, so
+//    that a mounted image can report its usage before it is loaded.
+//    A file with several links has an entry for each, all pointing
+//    at the same data and naming the first of them in first_link;
+//    link_count is the number of its entries.  Directories and files
+//    with one link name themselves.
+
+struct image_header
+{
+   char magic[8];
+   uint32_t version;
+   int32_t next_inode_nr;
+   uint64_t inode_count;
+   uint64_t inodes_offset;
+   uint64_t words_offset;
+   uint64_t words_count;
+   uint64_t names_offset;
+   uint64_t names_size;
+   uint64_t data_offset;
+   uint64_t data_size;
+};
+
+struct image_inode
+{
+   int32_t inode_nr;
+   uint32_t type;
+   uint64_t name_offset;
+   uint64_t name_size;
+   uint64_t first_child;
+   uint64_t child_count;
+   uint64_t data_offset;
+   uint64_t data_size;
+   uint64_t words_offset;
+   uint64_t words_count;
+   uint64_t subtree_bytes;
+   uint64_t subtree_inodes;
+   uint64_t first_link;
+   uint64_t link_count;
+};
+
+// class image_map -
+//    A read-only mapping of an image file.  All checks throw
+//    file_error if the image cannot be used.
+// ctor -
+//    Maps the file and checks that the header and the sections it
+//    describes lie inside the file.
+// check_children -
+//    Checks the entries of one directory:  that they lie inside the
+//    file, come after the directory in the table, and have valid and
+//    sorted names, and that they add up to the subtree usage of the
+//    directory.  Enough to load that directory safely.
+// check_tree -
+//    Checks every directory, that every entry has exactly one
+//    parent, that every inode has a distinct inode number, and that
+//    the links of every file are all there.
+// header, entry, words, name, data -
+//    Views into the mapped sections.
+
+class image_map
+{
+private:
+   string filename;
+   const char *base{nullptr};
+   size_t length{0};
+   file_error bad(const string &why) const;
+   void check_header() const;
+
+public:
+   explicit image_map(const string &filename_);
+   ~image_map();
+   image_map(const image_map &) = delete;
+   image_map &operator=(const image_map &) = delete;
+   void check_children(uint64_t index) const;
+   void check_tree() const;
+   const image_header &header() const;
+   const image_inode &entry(uint64_t index) const;
+   const uint64_t *words(const image_inode &node) const;
+   string_view name(const image_inode &node) const;
+   string_view data(const image_inode &node) const;
+};
+
+// save_image -
+//    Writes the tree rooted at state.top() to the file.  The image
+//    is written to a temporary file which is then renamed, so an
+//    existing image is never left half written.
+// load_image -
+//    Replaces the whole tree with the one in the image and makes
+//    its root the current directory.  The image is fully checked
+//    before the current tree is discarded.
+// mount_image -
+//    Replaces the whole tree with the image, without reading it.
+//    Directories are loaded from the mapping when first used and
+//    plain files refer to their bytes in place, so unused parts of
+//    the image cost no heap.  Changes stay in memory.
+
+void save_image(inode_state &state, const string &filename);
+void load_image(inode_state &state, const string &filename);
+void mount_image(inode_state &state, const string &filename);
+
+#endif
@@ -1,6 +1,9 @@
 // $Id: main.cpp,v 1.9 2016-01-14 16:16:52-08 - - $
 
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <utility>
@@ -11,17 +14,28 @@ using namespace std;
 #include "commands.h"
 #include "debug.h"
 #include "file_sys.h"
+#include "image.h"
+#include "server.h"
 #include "util.h"
 
 // scan_options
-//    Options analysis:  The only option is -Dflags.
+//    Options analysis:  -@flags sets debug flags, -i image starts
+//    from a tree saved with the save command, -m image mounts
+//    such a tree in place, loading directories as they are used,
+//    -b script runs a script in batch mode, and -s socket serves
+//    the tree to clients of a Unix-domain socket.
+
+string image_file;
+bool mount_in_place = false;
+string batch_file;
+string socket_name;
 
 void scan_options(int argc, char **argv)
 {
    opterr = 0;
    for (;;)
    {
-      int option = getopt(argc, argv, "@:");
+      int option = getopt(argc, argv, "@:b:i:m:s:");
       if (option == EOF)
          break;
       switch (option)
@@ -29,6 +43,17 @@ void scan_options(int argc, char **argv)
       case '@':
          debugflags::setflags(optarg);
          break;
+      case 'b':
+         batch_file = optarg;
+         break;
+      case 'i':
+      case 'm':
+         image_file = optarg;
+         mount_in_place = option == 'm';
+         break;
+      case 's':
+         socket_name = optarg;
+         break;
       default:
          complain() << "-" << static_cast<char>(option)
                     << ": invalid option" << endl;
@@ -41,8 +66,94 @@ void scan_options(int argc, char **argv)
    }
 }
 
+// batch_command -
+//    One line of a batch script, already parsed into a pipeline.
+// run_batch -
+//    Reads the whole script (- is cin), parses every line and looks
+//    up every command once, then runs the commands without prompts
+//    or echo and reports the throughput on cerr.  Lines with an
+//    unknown command are reported and skipped before anything runs.
+
+struct batch_command
+{
+   size_t line_nr;
+   pipeline commands;
+};
+
+void run_batch(inode_state &state, const string &filename)
+{
+   ifstream filein;
+   if (filename != "-")
+   {
+      filein.open(filename);
+      if (not filein)
+      {
+         complain() << filename << ": No such file or directory"
+                    << endl;
+         return;
+      }
+   }
+   istream &in = filename == "-" ? cin : filein;
+
+   vector<batch_command> script;
+   size_t line_nr = 0;
+   for (string line; getline(in, line);)
+   {
+      ++line_nr;
+      try
+      {
+         pipeline commands(line);
+         if (not commands.empty())
+            script.push_back({line_nr, move(commands)});
+      }
+      catch (command_error &error)
+      {
+         complain() << filename << ": " << line_nr << ": "
+                    << error.what() << endl;
+      }
+   }
+
+   size_t executed = 0;
+   auto start = chrono::steady_clock::now();
+   try
+   {
+      for (const batch_command &command : script)
+      {
+         ++executed;
+         try
+         {
+            command.commands.run(state);
+         }
+         catch (command_error &error)
+         {
+            complain() << filename << ": " << command.line_nr << ": "
+                       << error.what() << endl;
+         }
+         catch (file_error &error)
+         {
+            complain() << filename << ": " << command.line_nr << ": "
+                       << error.what() << endl;
+         }
+         rcu::reclaim();
+      }
+   }
+   catch (ysh_exit &)
+   {
+      // exit ends the script early.
+   }
+   cout.flush();
+   chrono::duration<double> elapsed =
+       chrono::steady_clock::now() - start;
+   cerr << execname() << ": " << filename << ": " << executed
+        << " commands in " << fixed << setprecision(3)
+        << elapsed.count() << " s (" << setprecision(0)
+        << (elapsed.count() > 0 ? executed / elapsed.count() : 0)
+        << " commands/sec)" << endl;
+}
+
 // main -
-//    Main program which loops reading commands until end of file.
+//    Main program which loops reading commands until end of file,
+//    or runs a batch script.
 
 int main(int argc, char **argv)
 {
@@ -53,9 +164,33 @@ int main(int argc, char **argv)
    scan_options(argc, argv);
    bool need_echo = want_echo();
    inode_state state;
-   state.set(make_shared<inode>(file_type::DIRECTORY_TYPE));
+   state.set(make_inode(file_type::DIRECTORY_TYPE));
    static_cast<directory *>(state.cur()->file().get())
        ->init(state.top(), state.cur());
+   if (not image_file.empty())
+   {
+      try
+      {
+         if (mount_in_place)
+            mount_image(state, image_file);
+         else
+            load_image(state, image_file);
+      }
+      catch (file_error &error)
+      {
+         complain() << error.what() << endl;
+      }
+   }
+   if (not socket_name.empty())
+   {
+      run_server(state, socket_name);
+      return exit_status_message();
+   }
+   if (not batch_file.empty())
+   {
+      run_batch(state, batch_file);
+      return exit_status_message();
+   }
    try
    {
       for (;;)
@@ -78,16 +213,15 @@ int main(int argc, char **argv)
             if (need_echo)
                cout << line << endl;
 
-            // Split the line into words and lookup the appropriate
-            // function.  Complain or call it.
-            wordvec words = split(line, " \t");
-            if (words.size() <= 0 ||
-                words[0].size() <= 0 ||
-                words[0][0] == '#')
+            // Parse the line into a pipeline, looking up the
+            // appropriate functions.  Complain or run it.
+            pipeline commands(line);
+            if (commands.empty())
                continue;
-            DEBUGF('y', "words = " << words);
-            command_fn fn = find_command_fn(words.at(0));
-            fn(state, words);
+            DEBUGF('y', "line = " << line);
+            commands.run(state);
+            // Free the versions replaced by the command.
+            rcu::reclaim();
          }
          catch (command_error &error)
          {
@@ -0,0 +1,106 @@
+// $Id: pmap.h,v 1.1 2026-10-19 11:30:00-07 - - $
+
+#ifndef __PMAP_H__
+#define __PMAP_H__
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "pool.h"
+
+// class pmap -
+// A persistent sorted map:  a treap whose nodes are never changed
+// once built.  Copying a pmap copies one pointer, and every update
+// copies only the nodes on the path to the key, sharing the rest
+// with the versions it was copied from.  So a version that has been
+// handed to readers can stay in use while a writer builds the next
+// one, and old versions cost only the nodes that differ.
+// Priorities come from hashing the key, so the shape of the tree
+// depends only on the keys in it.  Nodes come from a pool.
+// size, count, get, find, at -
+//    Lookups.  get returns a pointer to the value, or nullptr.
+// emplace -
+//    Inserts the key if it is not there; returns true if it did.
+// assign -
+//    Inserts the key or replaces its value.
+// erase -
+//    Removes the key; returns true if it was there.
+// begin, end -
+//    In-order iteration.  Iterators are valid as long as the version
+//    they came from is.
+// node_size -
+//    Bytes taken by one entry, not counting what the key and the
+//    value hold elsewhere.
+
+template <typename Key, typename Value, class Less = less<Key>>
+class pmap
+{
+public:
+   using key_type = Key;
+   using mapped_type = Value;
+   using value_type = pair<const key_type, mapped_type>;
+   class const_iterator;
+
+private:
+   struct node;
+   using node_ptr = shared_ptr<const node>;
+   node_ptr root;
+   static node_ptr make(value_type value, size_t priority,
+                        node_ptr left, node_ptr right);
+   static node_ptr insert(const node_ptr &tree, const key_type &key,
+                          mapped_type &value, bool replace,
+                          bool &changed);
+   static node_ptr remove(const node_ptr &tree, const key_type &key,
+                          bool &changed);
+   static node_ptr merge(const node_ptr &left, const node_ptr &right);
+
+public:
+   size_t size() const;
+   bool empty() const;
+   size_t count(const key_type &key) const;
+   const mapped_type *get(const key_type &key) const;
+   const_iterator find(const key_type &key) const;
+   const mapped_type &at(const key_type &key) const;
+   bool emplace(const key_type &key, mapped_type value);
+   void assign(const key_type &key, mapped_type value);
+   bool erase(const key_type &key);
+   void clear();
+   const_iterator begin() const;
+   const_iterator end() const;
+   static size_t node_size();
+};
+
+template <typename Key, typename Value, class Less>
+struct pmap<Key, Value, Less>::node
+{
+   value_type value;
+   size_t priority;
+   size_t count;
+   node_ptr left;
+   node_ptr right;
+   node(value_type value_, size_t priority_, node_ptr left_,
+        node_ptr right_);
+};
+
+template <typename Key, typename Value, class Less>
+class pmap<Key, Value, Less>::const_iterator
+{
+private:
+   friend class pmap<Key, Value, Less>;
+   vector<const node *> path;
+   void descend(const node *where);
+
+public:
+   const_iterator() = default;
+   const value_type &operator*() const;
+   const value_type *operator->() const;
+   const_iterator &operator++();
+   bool operator==(const const_iterator &) const;
+   bool operator!=(const const_iterator &) const;
+};
+
+#include "pmap.tcc"
+#endif
@@ -0,0 +1,299 @@
+// $Id: pmap.tcc,v 1.1 2026-10-19 11:30:00-07 - - $
+
+#include <stdexcept>
+
+//
+// Operations on pmap::node.
+//
+
+template <typename Key, typename Value, class Less>
+pmap<Key, Value, Less>::node::node(value_type value_, size_t priority_,
+                                   node_ptr left_, node_ptr right_)
+    : value(move(value_)), priority(priority_),
+      count(1 + (left_ ? left_->count : 0) +
+            (right_ ? right_->count : 0)),
+      left(move(left_)), right(move(right_)) {}
+
+//
+// Building new versions.  Nothing reachable from an existing root
+// is ever modified:  every function returns the root of a new tree,
+// or the same root if nothing changed.
+//
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::node_ptr
+pmap<Key, Value, Less>::make(value_type value, size_t priority,
+                             node_ptr left, node_ptr right)
+{
+   return allocate_shared<node>(pool_allocator<node>(), move(value),
+                                priority, move(left), move(right));
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::node_ptr
+pmap<Key, Value, Less>::insert(const node_ptr &tree,
+                               const key_type &key, mapped_type &value,
+                               bool replace, bool &changed)
+{
+   Less less;
+   if (tree == nullptr)
+   {
+      changed = true;
+      return make(value_type(key, move(value)), hash<key_type>{}(key),
+                  nullptr, nullptr);
+   }
+   if (less(key, tree->value.first))
+   {
+      node_ptr left = insert(tree->left, key, value, replace, changed);
+      if (not changed)
+         return tree;
+      if (left->priority <= tree->priority)
+         return make(tree->value, tree->priority, move(left),
+                     tree->right);
+      // Rotate right to keep the heap order on priorities.
+      return make(left->value, left->priority, left->left,
+                  make(tree->value, tree->priority, left->right,
+                       tree->right));
+   }
+   if (less(tree->value.first, key))
+   {
+      node_ptr right = insert(tree->right, key, value, replace,
+                              changed);
+      if (not changed)
+         return tree;
+      if (right->priority <= tree->priority)
+         return make(tree->value, tree->priority, tree->left,
+                     move(right));
+      // Rotate left to keep the heap order on priorities.
+      return make(right->value, right->priority,
+                  make(tree->value, tree->priority, tree->left,
+                       right->left),
+                  right->right);
+   }
+   if (not replace)
+      return tree;
+   changed = true;
+   return make(value_type(key, move(value)), tree->priority,
+               tree->left, tree->right);
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::node_ptr
+pmap<Key, Value, Less>::remove(const node_ptr &tree,
+                               const key_type &key, bool &changed)
+{
+   Less less;
+   if (tree == nullptr)
+      return tree;
+   if (less(key, tree->value.first))
+   {
+      node_ptr left = remove(tree->left, key, changed);
+      return changed ? make(tree->value, tree->priority, move(left),
+                            tree->right)
+                     : tree;
+   }
+   if (less(tree->value.first, key))
+   {
+      node_ptr right = remove(tree->right, key, changed);
+      return changed ? make(tree->value, tree->priority, tree->left,
+                            move(right))
+                     : tree;
+   }
+   changed = true;
+   return merge(tree->left, tree->right);
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::node_ptr
+pmap<Key, Value, Less>::merge(const node_ptr &left,
+                              const node_ptr &right)
+{
+   if (left == nullptr)
+      return right;
+   if (right == nullptr)
+      return left;
+   if (left->priority > right->priority)
+      return make(left->value, left->priority, left->left,
+                  merge(left->right, right));
+   return make(right->value, right->priority,
+               merge(left, right->left), right->right);
+}
+
+//
+// Operations on pmap.
+//
+
+template <typename Key, typename Value, class Less>
+size_t pmap<Key, Value, Less>::size() const
+{
+   return root ? root->count : 0;
+}
+
+template <typename Key, typename Value, class Less>
+bool pmap<Key, Value, Less>::empty() const
+{
+   return root == nullptr;
+}
+
+template <typename Key, typename Value, class Less>
+size_t pmap<Key, Value, Less>::count(const key_type &key) const
+{
+   return get(key) != nullptr;
+}
+
+template <typename Key, typename Value, class Less>
+const typename pmap<Key, Value, Less>::mapped_type *
+pmap<Key, Value, Less>::get(const key_type &key) const
+{
+   Less less;
+   for (const node *where = root.get(); where != nullptr;)
+   {
+      if (less(key, where->value.first))
+         where = where->left.get();
+      else if (less(where->value.first, key))
+         where = where->right.get();
+      else
+         return &where->value.second;
+   }
+   return nullptr;
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::const_iterator
+pmap<Key, Value, Less>::find(const key_type &key) const
+{
+   Less less;
+   const_iterator itor;
+   for (const node *where = root.get(); where != nullptr;)
+   {
+      if (less(key, where->value.first))
+      {
+         itor.path.push_back(where);
+         where = where->left.get();
+      }
+      else if (less(where->value.first, key))
+         where = where->right.get();
+      else
+      {
+         itor.path.push_back(where);
+         return itor;
+      }
+   }
+   return end();
+}
+
+template <typename Key, typename Value, class Less>
+const typename pmap<Key, Value, Less>::mapped_type &
+pmap<Key, Value, Less>::at(const key_type &key) const
+{
+   const mapped_type *value = get(key);
+   if (value == nullptr)
+      throw out_of_range("pmap::at");
+   return *value;
+}
+
+template <typename Key, typename Value, class Less>
+bool pmap<Key, Value, Less>::emplace(const key_type &key,
+                                     mapped_type value)
+{
+   bool changed = false;
+   root = insert(root, key, value, false, changed);
+   return changed;
+}
+
+template <typename Key, typename Value, class Less>
+void pmap<Key, Value, Less>::assign(const key_type &key,
+                                    mapped_type value)
+{
+   bool changed = false;
+   root = insert(root, key, value, true, changed);
+}
+
+template <typename Key, typename Value, class Less>
+bool pmap<Key, Value, Less>::erase(const key_type &key)
+{
+   bool changed = false;
+   root = remove(root, key, changed);
+   return changed;
+}
+
+template <typename Key, typename Value, class Less>
+void pmap<Key, Value, Less>::clear()
+{
+   root.reset();
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::const_iterator
+pmap<Key, Value, Less>::begin() const
+{
+   const_iterator itor;
+   itor.descend(root.get());
+   return itor;
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::const_iterator
+pmap<Key, Value, Less>::end() const
+{
+   return const_iterator();
+}
+
+template <typename Key, typename Value, class Less>
+size_t pmap<Key, Value, Less>::node_size()
+{
+   return sizeof(node);
+}
+
+//
+// Operations on pmap::const_iterator.  The path holds the nodes
+// still to be visited whose left subtrees are done; the top is the
+// current node.
+//
+
+template <typename Key, typename Value, class Less>
+void pmap<Key, Value, Less>::const_iterator::descend(const node *where)
+{
+   for (; where != nullptr; where = where->left.get())
+      path.push_back(where);
+}
+
+template <typename Key, typename Value, class Less>
+const typename pmap<Key, Value, Less>::value_type &
+pmap<Key, Value, Less>::const_iterator::operator*() const
+{
+   return path.back()->value;
+}
+
+template <typename Key, typename Value, class Less>
+const typename pmap<Key, Value, Less>::value_type *
+pmap<Key, Value, Less>::const_iterator::operator->() const
+{
+   return &path.back()->value;
+}
+
+template <typename Key, typename Value, class Less>
+typename pmap<Key, Value, Less>::const_iterator &
+pmap<Key, Value, Less>::const_iterator::operator++()
+{
+   const node *done = path.back();
+   path.pop_back();
+   descend(done->right.get());
+   return *this;
+}
+
+template <typename Key, typename Value, class Less>
+bool pmap<Key, Value, Less>::const_iterator::operator==(
+    const const_iterator &that) const
+{
+   if (path.empty() || that.path.empty())
+      return path.empty() == that.path.empty();
+   return path.back() == that.path.back();
+}
+
+template <typename Key, typename Value, class Less>
+bool pmap<Key, Value, Less>::const_iterator::operator!=(
+    const const_iterator &that) const
+{
+   return not(*this == that);
+}
@@ -0,0 +1,65 @@
+// $Id: pool.cpp,v 1.1 2026-10-19 12:00:00-07 - - $
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+using namespace std;
+
+#include "debug.h"
+#include "pool.h"
+
+static constexpr size_t first_slab = 64;
+static constexpr size_t largest_slab = 65536;
+
+atomic<size_t> pool::slab_count{0};
+
+// The block size is rounded up to the alignment, so that every
+// block of a slab is aligned.
+
+pool::pool(size_t size_, size_t align_)
+    : block_size(max(size_, sizeof(block))),
+      align(max(align_, alignof(block))), per_slab(first_slab)
+{
+   block_size = (block_size + align - 1) / align * align;
+}
+
+// grow -
+//    Threads a new slab onto the free list.  Called with the lock
+//    held.
+
+void pool::grow()
+{
+   char *slab = static_cast<char *>(
+       ::operator new(per_slab * block_size, align_val_t{align}));
+   for (size_t index = per_slab; index > 0; --index)
+   {
+      block *fresh = reinterpret_cast<block *>(
+          slab + (index - 1) * block_size);
+      fresh->next = free_list;
+      free_list = fresh;
+   }
+   ++slab_count;
+   DEBUGF('p', "slab of " << per_slab << " blocks of " << block_size);
+   per_slab = min(2 * per_slab, largest_slab);
+}
+
+void *pool::allocate()
+{
+   lock_guard<mutex> guard(lock);
+   if (free_list == nullptr)
+      grow();
+   block *taken = free_list;
+   free_list = taken->next;
+   return taken;
+}
+
+void pool::deallocate(void *pointer)
+{
+   block *freed = static_cast<block *>(pointer);
+   lock_guard<mutex> guard(lock);
+   freed->next = free_list;
+   free_list = freed;
+}
+
+size_t pool::slabs() { return slab_count; }
@@ -0,0 +1,108 @@
+// $Id: pool.h,v 1.1 2026-10-19 12:00:00-07 - - $
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+using namespace std;
+
+// class pool -
+// Hands out blocks of one size, carved from slabs that hold many
+// blocks each.  Every slab holds twice as many blocks as the one
+// before, up to a limit, so a large tree costs a handful of slabs.
+// Freed blocks go on a free list and are handed out again before a
+// new slab is taken; slabs are never given back.  Locked, since the
+// last reference to an object may be dropped by any thread.
+// of -
+//    The pool for blocks of the given size and alignment, shared by
+//    every type with that size and alignment.  Pools are never
+//    destroyed, so objects may still be freed during exit.
+// allocate, deallocate -
+//    One block.
+// slabs -
+//    Number of slabs taken by all pools so far.
+
+class pool
+{
+private:
+   struct block
+   {
+      block *next;
+   };
+   size_t block_size;
+   size_t align;
+   size_t per_slab;
+   block *free_list{nullptr};
+   mutex lock;
+   static atomic<size_t> slab_count;
+   void grow();
+
+public:
+   pool(size_t size_, size_t align_);
+   pool(const pool &) = delete;
+   pool &operator=(const pool &) = delete;
+   void *allocate();
+   void deallocate(void *pointer);
+   static size_t slabs();
+   template <size_t size, size_t align_>
+   static pool &of();
+};
+
+template <size_t size, size_t align_>
+pool &pool::of()
+{
+   static pool &instance = *new pool(size, align_);
+   return instance;
+}
+
+// class pool_allocator -
+// An allocator for allocate_shared that takes single objects from
+// the pool for their size, so that an object and its control block
+// share one pooled block.  Arrays go to the heap as usual.
+
+template <typename T>
+class pool_allocator
+{
+public:
+   using value_type = T;
+   pool_allocator() = default;
+   template <typename U>
+   pool_allocator(const pool_allocator<U> &) {}
+   T *allocate(size_t count);
+   void deallocate(T *pointer, size_t count);
+};
+
+template <typename T>
+T *pool_allocator<T>::allocate(size_t count)
+{
+   if (count != 1)
+      return allocator<T>().allocate(count);
+   void *block = pool::of<sizeof(T), alignof(T)>().allocate();
+   return static_cast<T *>(block);
+}
+
+template <typename T>
+void pool_allocator<T>::deallocate(T *pointer, size_t count)
+{
+   if (count != 1)
+      allocator<T>().deallocate(pointer, count);
+   else
+      pool::of<sizeof(T), alignof(T)>().deallocate(pointer);
+}
+
+template <typename T, typename U>
+bool operator==(const pool_allocator<T> &, const pool_allocator<U> &)
+{
+   return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &)
+{
+   return false;
+}
+
+#endif
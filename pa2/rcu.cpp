@@ -0,0 +1,115 @@
+// $Id: rcu.cpp,v 1.1 2026-10-19 11:30:00-07 - - $
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+#include "rcu.h"
+
+// Each thread that reads owns a slot holding the epoch at which its
+// current read section began, or idle between sections.  Slots are
+// never freed:  a thread that exits gives its slot back for reuse.
+// Every retired deleter is tagged with the epoch it was retired in,
+// and the epoch then moves on, so a deleter may run once every busy
+// slot holds a later epoch.
+
+static constexpr uint64_t idle = numeric_limits<uint64_t>::max();
+
+struct rcu::slot
+{
+   atomic<uint64_t> epoch{idle};
+   atomic<bool> taken{true};
+   int depth{0};
+   slot *next{nullptr};
+};
+
+struct retired
+{
+   uint64_t tag;
+   function<void()> deleter;
+};
+
+// The shared state is never destroyed, so that cells destroyed
+// during exit may still retire their values.
+
+static atomic<uint64_t> &global_epoch = *new atomic<uint64_t>{1};
+static mutex &retired_lock = *new mutex;
+static vector<retired> &retired_list = *new vector<retired>;
+static atomic<size_t> retired_count{0};
+atomic<rcu::slot *> rcu::slots{nullptr};
+
+rcu::slot &rcu::thread_slot()
+{
+   struct owner
+   {
+      slot *mine{nullptr};
+      ~owner()
+      {
+         if (mine != nullptr)
+            mine->taken = false;
+      }
+   };
+   static thread_local owner me;
+   if (me.mine != nullptr)
+      return *me.mine;
+   for (slot *free = slots; free != nullptr; free = free->next)
+   {
+      bool taken = false;
+      if (free->taken.compare_exchange_strong(taken, true))
+         return *(me.mine = free);
+   }
+   slot *fresh = new slot;
+   fresh->next = slots;
+   while (not slots.compare_exchange_weak(fresh->next, fresh))
+      ;
+   return *(me.mine = fresh);
+}
+
+rcu::read_guard::read_guard() : mine(thread_slot())
+{
+   if (mine.depth++ == 0)
+      mine.epoch = global_epoch.load();
+}
+
+rcu::read_guard::~read_guard()
+{
+   if (--mine.depth == 0)
+      mine.epoch = idle;
+}
+
+void rcu::retire(function<void()> deleter)
+{
+   uint64_t tag = global_epoch++;
+   lock_guard<mutex> guard(retired_lock);
+   retired_list.push_back({tag, move(deleter)});
+   ++retired_count;
+}
+
+void rcu::reclaim()
+{
+   if (retired_count == 0)
+      return;
+   // Anything retired after reading the epoch must wait for the
+   // next call, as readers may have started after the scan below.
+   uint64_t oldest = global_epoch;
+   for (slot *busy = slots; busy != nullptr; busy = busy->next)
+      oldest = min<uint64_t>(oldest, busy->epoch);
+   vector<retired> ready;
+   vector<retired> waiting;
+   {
+      lock_guard<mutex> guard(retired_lock);
+      for (auto &entry : retired_list)
+         (entry.tag < oldest ? ready : waiting).push_back(move(entry));
+      retired_list.swap(waiting);
+      retired_count -= ready.size();
+   }
+   // Deleters may free inodes whose cells retire more, so run them
+   // after letting go of the lock.
+   for (auto &entry : ready)
+      entry.deleter();
+}
+
+size_t rcu::pending() { return retired_count; }
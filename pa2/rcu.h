@@ -0,0 +1,100 @@
+// $Id: rcu.h,v 1.1 2026-10-19 11:30:00-07 - - $
+
+#ifndef __RCU_H__
+#define __RCU_H__
+
+#include <atomic>
+#include <functional>
+using namespace std;
+
+// class rcu -
+// Epoch-based reclamation, so that readers may follow pointers that
+// writers replace without either side taking a lock.  A writer puts
+// a new version in place and retires the old one, which is freed
+// only once every read section that might still see it has ended.
+// read_guard -
+//    Marks a read section for the lifetime of the guard.  Guards may
+//    nest.  Costs two stores to a slot owned by the thread.
+// retire -
+//    Schedules the deleter to run once no read section that began
+//    before the call is still active.
+// reclaim -
+//    Runs the deleters that are safe to run now.  Called between
+//    commands, never from inside a read section.
+// pending -
+//    Number of deleters not run yet.
+
+class rcu
+{
+private:
+   struct slot;
+   static atomic<slot *> slots;
+   static slot &thread_slot();
+
+public:
+   class read_guard
+   {
+   private:
+      slot &mine;
+
+   public:
+      read_guard();
+      ~read_guard();
+      read_guard(const read_guard &) = delete;
+      read_guard &operator=(const read_guard &) = delete;
+   };
+   static void retire(function<void()> deleter);
+   static void reclaim();
+   static size_t pending();
+};
+
+// class rcu_cell -
+// Holds one version of a value that readers copy without locking
+// while writers replace it.  Values should be cheap to copy, such as
+// a shared pointer or a persistent map.  Writers must be serialized
+// by the caller.
+// read -
+//    A copy of the current version.
+// store -
+//    Makes the value the current version and retires the old one.
+
+template <typename T>
+class rcu_cell
+{
+private:
+   atomic<const T *> current;
+
+public:
+   explicit rcu_cell(T value = T());
+   ~rcu_cell();
+   rcu_cell(const rcu_cell &) = delete;
+   rcu_cell &operator=(const rcu_cell &) = delete;
+   T read() const;
+   void store(T value);
+};
+
+template <typename T>
+rcu_cell<T>::rcu_cell(T value) : current(new T(move(value))) {}
+
+template <typename T>
+rcu_cell<T>::~rcu_cell()
+{
+   const T *old = current.load();
+   rcu::retire([old] { delete old; });
+}
+
+template <typename T>
+T rcu_cell<T>::read() const
+{
+   rcu::read_guard guard;
+   return *current.load();
+}
+
+template <typename T>
+void rcu_cell<T>::store(T value)
+{
+   const T *old = current.exchange(new T(move(value)));
+   rcu::retire([old] { delete old; });
+}
+
+#endif
@@ -0,0 +1,304 @@
+// $Id: rcubench.cpp,v 1.1 2026-10-19 15:30:00-07 - - $
+
+// rcubench -
+//    Stresses the lock-free read path:  reader threads resolve and
+//    read files and list directories in one shared tree while a
+//    single writer rewrites, removes and makes files in it.  Writes
+//    a JSON report to cout:  for readers and the writer, how many
+//    operations each did per second and their latency, how many
+//    reads found a file missing, and how many retired versions were
+//    still waiting to be freed at the end.  A body that does not
+//    read back as one of the bodies the writer makes is counted as
+//    torn; there should be none.
+//
+//    rcubench [-r readers] [-n entries] [-t seconds] [-s seed]
+//
+//    The tree holds n files, 16 to a directory.  Latency is sampled
+//    every 16th operation.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+#include "debug.h"
+#include "file_sys.h"
+#include "rcu.h"
+#include "util.h"
+
+size_t reader_count = 4;
+size_t entry_count = 4096;
+double run_seconds = 2;
+unsigned seed = 1;
+constexpr size_t per_dir = 16;
+constexpr size_t sample_every = 16;
+
+void scan_options(int argc, char **argv)
+{
+   opterr = 0;
+   for (;;)
+   {
+      int option = getopt(argc, argv, "@:n:r:s:t:");
+      if (option == EOF)
+         break;
+      switch (option)
+      {
+      case '@':
+         debugflags::setflags(optarg);
+         break;
+      case 'n':
+         entry_count = max<size_t>(1, strtoul(optarg, nullptr, 10));
+         break;
+      case 'r':
+         reader_count = strtoul(optarg, nullptr, 10);
+         break;
+      case 's':
+         seed = strtoul(optarg, nullptr, 10);
+         break;
+      case 't':
+         run_seconds = strtod(optarg, nullptr);
+         break;
+      default:
+         complain() << "-" << static_cast<char>(option)
+                    << ": invalid option" << endl;
+         break;
+      }
+   }
+   if (optind != argc)
+      complain() << "usage: " << execname()
+                 << " [-r readers] [-n entries] [-t seconds]"
+                 << " [-s seed]" << endl;
+}
+
+// struct tally -
+//    What one thread did, with a sample of its latencies in
+//    microseconds.
+
+struct tally
+{
+   size_t operations{0};
+   size_t missing{0};
+   size_t torn{0};
+   vector<double> micros;
+};
+
+string dir_name(size_t index)
+{
+   return "d" + to_string(index / per_dir);
+}
+
+string file_name(size_t index)
+{
+   return "f" + to_string(index);
+}
+
+// make_body -
+//    A body of the given number of copies of one word, so that a
+//    reader can tell whether what it sees was written whole.
+
+file_data_ptr make_body(size_t version, size_t count)
+{
+   wordvec words(count, "v" + to_string(version));
+   return make_shared<file_data>(
+       word_range(words.cbegin(), words.cend()));
+}
+
+bool whole_body(const file_data &body)
+{
+   if (body.words() == 0)
+      return true;
+   string_view first = body.word(0);
+   for (size_t index = 1; index < body.words(); ++index)
+      if (body.word(index) != first)
+         return false;
+   return true;
+}
+
+void build(const inode_ptr &root)
+{
+   directory *top = static_cast<directory *>(root->file().get());
+   for (size_t index = 0; index < entry_count; ++index)
+   {
+      if (index % per_dir == 0)
+         top->mkdir(dir_name(index));
+      directory *parent = static_cast<directory *>(
+          top->entries().at(dir_name(index))->file().get());
+      inode_ptr file = parent->mkfile(file_name(index));
+      directory::write(file, make_body(0, 1 + index % 8));
+   }
+}
+
+// read_loop -
+//    Reads random files by path, and lists the directory of every
+//    8th one, until told to stop.
+
+void read_loop(const inode_ptr &root, unsigned thread_seed,
+               const atomic<bool> &stop, tally &counts)
+{
+   inode_state state;
+   state.mount(root);
+   mt19937 random(thread_seed);
+   uniform_int_distribution<size_t> pick(0, entry_count - 1);
+   while (not stop)
+   {
+      size_t index = pick(random);
+      auto start = chrono::steady_clock::now();
+      try
+      {
+         string parent = "/" + dir_name(index);
+         file_data_ptr body = state.resolve(parent + "/" +
+                                            file_name(index))
+                                  ->file()
+                                  ->readfile();
+         if (not whole_body(*body))
+            ++counts.torn;
+         if (counts.operations % 8 == 0)
+         {
+            inode_ptr listed = state.resolve(parent);
+            for (const auto &entry :
+                 static_cast<directory *>(listed->file().get())
+                     ->entries())
+               if (entry.second == nullptr)
+                  ++counts.torn;
+         }
+      }
+      catch (file_error &)
+      {
+         ++counts.missing;
+      }
+      if (counts.operations++ % sample_every == 0)
+      {
+         chrono::duration<double, micro> elapsed =
+             chrono::steady_clock::now() - start;
+         counts.micros.push_back(elapsed.count());
+      }
+      rcu::reclaim();
+   }
+   state.mount(nullptr);
+   rcu::reclaim();
+}
+
+// write_loop -
+//    Rewrites a random file most of the time, and otherwise removes
+//    it, or makes it again if it is gone.
+
+void write_loop(const inode_ptr &root, const atomic<bool> &stop,
+                tally &counts)
+{
+   directory *top = static_cast<directory *>(root->file().get());
+   mt19937 random(seed);
+   uniform_int_distribution<size_t> pick(0, entry_count - 1);
+   size_t version = 0;
+   while (not stop)
+   {
+      size_t index = pick(random);
+      auto start = chrono::steady_clock::now();
+      directory *parent = static_cast<directory *>(
+          top->entries().at(dir_name(index))->file().get());
+      string name = file_name(index);
+      ++version;
+      file_data_ptr body = make_body(version, 1 + version % 8);
+      if (parent->entries().get(name) == nullptr)
+         directory::write(parent->mkfile(name), body);
+      else if (random() % 4 == 0)
+         parent->remove(name);
+      else
+         parent->write(name, body);
+      if (counts.operations++ % sample_every == 0)
+      {
+         chrono::duration<double, micro> elapsed =
+             chrono::steady_clock::now() - start;
+         counts.micros.push_back(elapsed.count());
+      }
+      rcu::reclaim();
+   }
+}
+
+double percentile(const vector<double> &sorted, double fraction)
+{
+   if (sorted.empty())
+      return 0;
+   size_t index = static_cast<size_t>(fraction * sorted.size());
+   return sorted[min(index, sorted.size() - 1)];
+}
+
+void report_side(const string &name, const vector<tally> &counts,
+                 double seconds)
+{
+   tally total;
+   for (const tally &one : counts)
+   {
+      total.operations += one.operations;
+      total.missing += one.missing;
+      total.torn += one.torn;
+      total.micros.insert(total.micros.end(), one.micros.cbegin(),
+                          one.micros.cend());
+   }
+   sort(total.micros.begin(), total.micros.end());
+   cout << "  \"" << name << "\": {"
+        << "\"operations\": " << total.operations
+        << ", \"per_second\": " << total.operations / seconds
+        << ", \"missing\": " << total.missing
+        << ", \"torn\": " << total.torn << "," << endl
+        << "    \"latency_us\": {"
+        << "\"p50\": " << percentile(total.micros, 0.50)
+        << ", \"p90\": " << percentile(total.micros, 0.90)
+        << ", \"p99\": " << percentile(total.micros, 0.99)
+        << ", \"max\": "
+        << (total.micros.empty() ? 0 : total.micros.back()) << "}}";
+}
+
+int main(int argc, char **argv)
+{
+   execname(argv[0]);
+   scan_options(argc, argv);
+   if (exit_status::get() != EXIT_SUCCESS)
+      return exit_status::get();
+   inode_state state;
+   state.set(make_inode(file_type::DIRECTORY_TYPE));
+   static_cast<directory *>(state.cur()->file().get())
+       ->init(state.top(), state.cur());
+   inode_ptr root = state.top();
+   build(root);
+   rcu::reclaim();
+
+   atomic<bool> stop{false};
+   vector<tally> readers(reader_count);
+   vector<tally> writer(1);
+   vector<thread> threads;
+   auto begin = chrono::steady_clock::now();
+   for (size_t index = 0; index < reader_count; ++index)
+      threads.emplace_back(read_loop, cref(root), seed + 1 + index,
+                           cref(stop), ref(readers[index]));
+   thread writing(write_loop, cref(root), cref(stop), ref(writer[0]));
+   this_thread::sleep_for(chrono::duration<double>(run_seconds));
+   stop = true;
+   writing.join();
+   for (thread &reading : threads)
+      reading.join();
+   chrono::duration<double> elapsed =
+       chrono::steady_clock::now() - begin;
+   rcu::reclaim();
+
+   cout << fixed << setprecision(3);
+   cout << "{" << endl;
+   cout << "  \"readers\": " << reader_count << "," << endl;
+   cout << "  \"entries\": " << entry_count << "," << endl;
+   cout << "  \"seconds\": " << elapsed.count() << "," << endl;
+   report_side("read", readers, elapsed.count());
+   cout << "," << endl;
+   report_side("write", writer, elapsed.count());
+   cout << "," << endl;
+   cout << "  \"pending_versions\": " << rcu::pending() << endl;
+   cout << "}" << endl;
+   return exit_status::get();
+}
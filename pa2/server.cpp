@@ -0,0 +1,203 @@
+// $Id: server.cpp,v 1.1 2026-10-19 11:20:00-07 - - $
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "server.h"
+#include "util.h"
+
+// The tree shared by all sessions.  Commands that only read take
+// no lock:  directories and files are read as immutable versions.
+// Commands that write are serialized by write_lock, which a session
+// holds from begin until it commits or rolls back.  A load in one
+// session replaces shared_root, and every other session moves to
+// the new root before its next command.
+
+static mutex write_lock;
+static rcu_cell<inode_ptr> shared_root;
+
+// fd_streambuf -
+//    A buffered stream buffer over a connected socket.  Closes the
+//    socket when destroyed.
+
+class fd_streambuf : public streambuf
+{
+private:
+   int fd;
+   char inbuf[4096];
+   char outbuf[4096];
+
+protected:
+   virtual int_type underflow() override;
+   virtual int_type overflow(int_type ch) override;
+   virtual int sync() override;
+
+public:
+   explicit fd_streambuf(int fd_);
+   ~fd_streambuf();
+   fd_streambuf(const fd_streambuf &) = delete;
+   fd_streambuf &operator=(const fd_streambuf &) = delete;
+};
+
+fd_streambuf::fd_streambuf(int fd_) : fd(fd_)
+{
+   setg(inbuf, inbuf, inbuf);
+   setp(outbuf, outbuf + sizeof outbuf);
+}
+
+fd_streambuf::~fd_streambuf()
+{
+   sync();
+   close(fd);
+}
+
+fd_streambuf::int_type fd_streambuf::underflow()
+{
+   ssize_t count;
+   do
+      count = read(fd, inbuf, sizeof inbuf);
+   while (count < 0 && errno == EINTR);
+   if (count <= 0)
+      return traits_type::eof();
+   setg(inbuf, inbuf, inbuf + count);
+   return traits_type::to_int_type(*gptr());
+}
+
+fd_streambuf::int_type fd_streambuf::overflow(int_type ch)
+{
+   if (sync() < 0)
+      return traits_type::eof();
+   if (not traits_type::eq_int_type(ch, traits_type::eof()))
+   {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+   }
+   return traits_type::not_eof(ch);
+}
+
+int fd_streambuf::sync()
+{
+   for (const char *next = pbase(); next < pptr();)
+   {
+      ssize_t count = send(fd, next, pptr() - next, MSG_NOSIGNAL);
+      if (count < 0 && errno == EINTR)
+         continue;
+      if (count <= 0)
+      {
+         setp(outbuf, outbuf + sizeof outbuf);
+         return -1;
+      }
+      next += count;
+   }
+   setp(outbuf, outbuf + sizeof outbuf);
+   return 0;
+}
+
+// run_session -
+//    Reads and runs commands from one connection until it closes.
+
+static void run_session(int fd)
+{
+   fd_streambuf buffer(fd);
+   iostream client(&buffer);
+   client << boolalpha;
+   inode_state state;
+   state.setout(client);
+   state.mount(shared_root.read());
+   unique_lock<mutex> guard(write_lock, defer_lock);
+   DEBUGF('s', "session " << fd << " started");
+   for (;;)
+   {
+      client << state.prompt() << flush;
+      string line;
+      if (not getline(client, line))
+         break;
+      try
+      {
+         pipeline commands(line);
+         if (commands.empty())
+            continue;
+         if (commands.writes() && not guard.owns_lock())
+            guard.lock();
+         inode_ptr root = shared_root.read();
+         if (state.top() != root)
+            state.mount(root);
+         commands.run(state);
+         if (guard.owns_lock() && state.top() != root)
+            shared_root.store(state.top());
+      }
+      catch (command_error &error)
+      {
+         client << execname() << ": " << error.what() << endl;
+      }
+      catch (file_error &error)
+      {
+         client << execname() << ": " << error.what() << endl;
+      }
+      catch (ysh_exit &)
+      {
+         break;
+      }
+      if (guard.owns_lock() && not state.in_transaction())
+         guard.unlock();
+      rcu::reclaim();
+   }
+   if (state.in_transaction())
+      state.rollback();
+   if (guard.owns_lock())
+      guard.unlock();
+   state.mount(nullptr);
+   rcu::reclaim();
+   DEBUGF('s', "session " << fd << " ended");
+}
+
+void run_server(inode_state &state, const string &socketname)
+{
+   sockaddr_un address{};
+   address.sun_family = AF_UNIX;
+   if (socketname.size() >= sizeof address.sun_path)
+   {
+      complain() << socketname << ": socket name too long" << endl;
+      return;
+   }
+   strcpy(address.sun_path, socketname.c_str());
+   int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (listener < 0)
+   {
+      complain() << "socket: " << strerror(errno) << endl;
+      return;
+   }
+   unlink(socketname.c_str());
+   if (bind(listener, reinterpret_cast<sockaddr *>(&address),
+            sizeof address) < 0 ||
+       listen(listener, SOMAXCONN) < 0)
+   {
+      complain() << socketname << ": " << strerror(errno) << endl;
+      close(listener);
+      return;
+   }
+   shared_root.store(state.top());
+   DEBUGF('s', "listening on " << socketname);
+   for (;;)
+   {
+      int fd = accept(listener, nullptr, nullptr);
+      if (fd < 0)
+      {
+         if (errno != EINTR)
+            complain() << "accept: " << strerror(errno) << endl;
+         continue;
+      }
+      thread(run_session, fd).detach();
+   }
+}
@@ -0,0 +1,26 @@
+// $Id: server.h,v 1.1 2026-10-19 11:20:00-07 - - $
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <string>
+using namespace std;
+
+#include "file_sys.h"
+
+// run_server -
+//    Listens on a Unix-domain socket and serves every connection on
+//    its own thread.  Each session has its own cwd, prompt and
+//    output, and all of them share the tree of the given state.
+//    Commands that change the tree are serialized by one lock, and
+//    all others take no lock at all, reading the versions of each
+//    directory that were current when they looked.  A session that
+//    begins a transaction keeps other writers out until it commits
+//    or rolls back; readers still see its changes as they are made.
+//    A session ends at end of file or exit, rolling back any open
+//    transaction.  Only returns if the socket cannot be
+//    set up, after complaining.
+
+void run_server(inode_state &state, const string &socketname);
+
+#endif
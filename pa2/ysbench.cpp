@@ -0,0 +1,260 @@
+// $Id: ysbench.cpp,v 1.1 2026-10-19 11:45:00-07 - - $
+
+// ysbench -
+//    Runs a yshell script in process, as yshell -b does, and writes
+//    a JSON report to cout:  for every command, how many times it ran,
+//    how many failed, and its latency, and for the whole run the
+//    time taken, the peak resident set size and the slabs taken by
+//    the pools.  Lines are grouped by their first word.  The output
+//    of the commands is counted and thrown away, so that the terminal
+//    is not measured.
+//
+//    ysbench [-@flags] [-i image | -m image] script
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <streambuf>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "file_sys.h"
+#include "image.h"
+#include "rcu.h"
+#include "util.h"
+
+string image_file;
+bool mount_in_place = false;
+string script_file;
+
+void scan_options(int argc, char **argv)
+{
+   opterr = 0;
+   for (;;)
+   {
+      int option = getopt(argc, argv, "@:i:m:");
+      if (option == EOF)
+         break;
+      switch (option)
+      {
+      case '@':
+         debugflags::setflags(optarg);
+         break;
+      case 'i':
+      case 'm':
+         image_file = optarg;
+         mount_in_place = option == 'm';
+         break;
+      default:
+         complain() << "-" << static_cast<char>(option)
+                    << ": invalid option" << endl;
+         break;
+      }
+   }
+   if (optind + 1 != argc)
+      complain() << "usage: " << execname()
+                 << " [-i image | -m image] script" << endl;
+   else
+      script_file = argv[optind];
+}
+
+// class discard -
+//    A streambuf that counts what is written to it and keeps none.
+
+class discard : public streambuf
+{
+private:
+   size_t bytes{0};
+
+protected:
+   int_type overflow(int_type byte) override
+   {
+      if (not traits_type::eq_int_type(byte, traits_type::eof()))
+         ++bytes;
+      return traits_type::not_eof(byte);
+   }
+   streamsize xsputn(const char *, streamsize count) override
+   {
+      bytes += count;
+      return count;
+   }
+
+public:
+   size_t size() const { return bytes; }
+};
+
+// struct timing -
+//    The latencies of every run of one command, in microseconds.
+
+struct timing
+{
+   vector<double> micros;
+   size_t errors{0};
+};
+
+double percentile(const vector<double> &sorted, double fraction)
+{
+   size_t index = static_cast<size_t>(fraction * sorted.size());
+   return sorted[min(index, sorted.size() - 1)];
+}
+
+string quoted(const string &text)
+{
+   string result = "\"";
+   for (char byte : text)
+   {
+      if (byte == '"' || byte == '\\')
+         result += '\\';
+      result += byte;
+   }
+   return result + "\"";
+}
+
+void report(const map<string, timing> &timings, size_t output,
+            double seconds)
+{
+   rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   size_t commands = 0;
+   for (const auto &entry : timings)
+      commands += entry.second.micros.size();
+   cout << fixed << setprecision(3);
+   cout << "{" << endl;
+   cout << "  \"script\": " << quoted(script_file) << "," << endl;
+   cout << "  \"image\": " << quoted(image_file) << "," << endl;
+   cout << "  \"commands\": " << commands << "," << endl;
+   cout << "  \"seconds\": " << seconds << "," << endl;
+   cout << "  \"output_bytes\": " << output << "," << endl;
+   cout << "  \"peak_rss_kb\": " << usage.ru_maxrss << "," << endl;
+   cout << "  \"pool_slabs\": " << pool::slabs() << "," << endl;
+   cout << "  \"latency_us\": {";
+   string comma = "";
+   for (const auto &entry : timings)
+   {
+      vector<double> sorted = entry.second.micros;
+      sort(sorted.begin(), sorted.end());
+      double total = 0;
+      for (double micros : sorted)
+         total += micros;
+      cout << comma << endl
+           << "    " << quoted(entry.first) << ": {"
+           << "\"count\": " << sorted.size()
+           << ", \"errors\": " << entry.second.errors
+           << ", \"mean\": " << total / sorted.size()
+           << ", \"p50\": " << percentile(sorted, 0.50)
+           << ", \"p90\": " << percentile(sorted, 0.90)
+           << ", \"p99\": " << percentile(sorted, 0.99)
+           << ", \"max\": " << sorted.back() << "}";
+      comma = ",";
+   }
+   cout << endl
+        << "  }" << endl;
+   cout << "}" << endl;
+}
+
+// run_script -
+//    Parses every line before running any, then runs them, timing
+//    each one together with the reclamation that follows it.
+
+void run_script(inode_state &state, istream &in)
+{
+   vector<pair<string, pipeline>> script;
+   size_t line_nr = 0;
+   for (string line; getline(in, line);)
+   {
+      ++line_nr;
+      try
+      {
+         pipeline commands(line);
+         if (not commands.empty())
+            script.emplace_back(split(line, " \t")[0], move(commands));
+      }
+      catch (command_error &error)
+      {
+         complain() << script_file << ": " << line_nr << ": "
+                    << error.what() << endl;
+      }
+   }
+
+   discard sink;
+   ostream out(&sink);
+   out << boolalpha;
+   state.setout(out);
+   map<string, timing> timings;
+   auto begin = chrono::steady_clock::now();
+   for (const auto &command : script)
+   {
+      timing &entry = timings[command.first];
+      auto start = chrono::steady_clock::now();
+      try
+      {
+         command.second.run(state);
+      }
+      catch (command_error &)
+      {
+         ++entry.errors;
+      }
+      catch (file_error &)
+      {
+         ++entry.errors;
+      }
+      catch (ysh_exit &)
+      {
+         break;
+      }
+      rcu::reclaim();
+      chrono::duration<double, micro> elapsed =
+          chrono::steady_clock::now() - start;
+      entry.micros.push_back(elapsed.count());
+   }
+   chrono::duration<double> elapsed =
+       chrono::steady_clock::now() - begin;
+   state.setout(cout);
+   report(timings, sink.size(), elapsed.count());
+}
+
+int main(int argc, char **argv)
+{
+   execname(argv[0]);
+   scan_options(argc, argv);
+   if (script_file.empty())
+      return exit_status::get();
+   ifstream in(script_file);
+   if (not in)
+   {
+      complain() << script_file << ": No such file or directory"
+                 << endl;
+      return exit_status::get();
+   }
+   inode_state state;
+   state.set(make_inode(file_type::DIRECTORY_TYPE));
+   static_cast<directory *>(state.cur()->file().get())
+       ->init(state.top(), state.cur());
+   if (not image_file.empty())
+   {
+      try
+      {
+         if (mount_in_place)
+            mount_image(state, image_file);
+         else
+            load_image(state, image_file);
+      }
+      catch (file_error &error)
+      {
+         complain() << error.what() << endl;
+         return exit_status::get();
+      }
+   }
+   run_script(state, in);
+   return exit_status::get();
+}
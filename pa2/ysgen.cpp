@@ -0,0 +1,356 @@
+// $Id: ysgen.cpp,v 1.1 2026-10-19 11:45:00-07 - - $
+
+// ysgen -
+//    Writes a yshell script to cout that builds a synthetic tree of
+//    the given shape, then walks it with cd, ls, cat and lsr, makes
+//    and removes files, and finally removes the whole tree with rm
+//    and rmr.  Meant to be run by ysbench or yshell -b.
+//
+//    ysgen [-n entries] [-s words] [-r seed] [-t] shape
+//
+//    wide    n files and n/16 directories in one directory.
+//    deep    a chain of n directories with a file in each.
+//    random  n entries, one in four a directory, each placed in a
+//            random directory made before it.
+//    small   n files of one word, 64 to a directory.
+//    large   n/64 files of 1024 times s words, 4 to a directory.
+//
+//    Every file has s words unless the shape says otherwise, and
+//    the same seed always gives the same script.
+//
+//    With -t the script only builds the tree, removes it with one
+//    rmr, and does both again, so that ysbench times the teardown
+//    of the whole tree and a build that reuses its inode numbers.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+#include "util.h"
+
+size_t entry_count = 1000;
+size_t word_count = 4;
+unsigned seed = 1;
+bool teardown_only = false;
+string shape;
+const vector<string> shapes{"wide", "deep", "random", "small",
+                            "large"};
+
+void scan_options(int argc, char **argv)
+{
+   opterr = 0;
+   for (;;)
+   {
+      int option = getopt(argc, argv, "n:r:s:t");
+      if (option == EOF)
+         break;
+      switch (option)
+      {
+      case 'n':
+         entry_count = strtoul(optarg, nullptr, 10);
+         break;
+      case 'r':
+         seed = strtoul(optarg, nullptr, 10);
+         break;
+      case 's':
+         word_count = strtoul(optarg, nullptr, 10);
+         break;
+      case 't':
+         teardown_only = true;
+         break;
+      default:
+         complain() << "-" << static_cast<char>(option)
+                    << ": invalid option" << endl;
+         break;
+      }
+   }
+   if (optind + 1 != argc)
+      complain() << "usage: " << execname()
+                 << " [-n entries] [-s words] [-r seed] [-t] shape"
+                 << endl;
+   else if (find(shapes.cbegin(), shapes.cend(), argv[optind]) ==
+            shapes.cend())
+      complain() << argv[optind] << ": unknown shape" << endl;
+   else
+      shape = argv[optind];
+}
+
+// class generator -
+//    Keeps the directories and files made so far, each as the index
+//    of its directory and its name, so that later phases can visit
+//    them.  Full paths are built only for the few entries a phase
+//    samples, so the script and the generator take space linear in
+//    the number of entries even for a deep tree.  Entries made in
+//    the directory the script is in are named relative to it.  The
+//    tree is built under one top directory named after the shape,
+//    so that the script ends by removing it with rmr.
+
+class generator
+{
+private:
+   static constexpr size_t root = -1;
+   struct entry
+   {
+      size_t parent;
+      string name;
+   };
+   mt19937 random;
+   string top;
+   vector<entry> dirs;
+   vector<entry> files;
+   size_t cwd{root};
+   size_t counter{0};
+   string body(size_t count);
+   size_t pick(size_t limit);
+   string path(size_t dir) const;
+   string path(const entry &file) const;
+   string place(size_t parent, const string &name) const;
+
+public:
+   generator(const string &shape_, unsigned seed_);
+   size_t mkdir(size_t parent);
+   size_t make(size_t parent, size_t count);
+   void enter(size_t dir);
+   void leave();
+   void build(size_t entries, size_t words);
+   void walk();
+   void churn();
+   void remove();
+   void teardown();
+};
+
+generator::generator(const string &shape_, unsigned seed_)
+    : random(seed_), top(shape_)
+{
+   cout << "# " << execname() << " " << shape_ << " seed " << seed_
+        << endl;
+   cout << "mkdir " << top << endl;
+   dirs.push_back({root, top});
+}
+
+string generator::body(size_t count)
+{
+   string text;
+   for (size_t index = 0; index < count; ++index)
+   {
+      text += ' ';
+      text += "w" + to_string(pick(1000));
+   }
+   return text;
+}
+
+size_t generator::pick(size_t limit)
+{
+   return uniform_int_distribution<size_t>(0, limit - 1)(random);
+}
+
+// path -
+//    The path of a directory or a file from the root, without a
+//    leading slash.
+
+string generator::path(size_t dir) const
+{
+   vector<const string *> names;
+   for (; dir != root; dir = dirs[dir].parent)
+      names.push_back(&dirs[dir].name);
+   string result;
+   for (auto name = names.crbegin(); name != names.crend(); ++name)
+   {
+      if (not result.empty())
+         result += '/';
+      result += **name;
+   }
+   return result;
+}
+
+string generator::path(const entry &file) const
+{
+   return path(file.parent) + "/" + file.name;
+}
+
+// place -
+//    The name for an entry in the directory, relative to the
+//    directory the script is in if it is that one.
+
+string generator::place(size_t parent, const string &name) const
+{
+   return parent == cwd ? name : path(parent) + "/" + name;
+}
+
+size_t generator::mkdir(size_t parent)
+{
+   string name = "d" + to_string(counter++);
+   cout << "mkdir " << place(parent, name) << endl;
+   dirs.push_back({parent, name});
+   return dirs.size() - 1;
+}
+
+size_t generator::make(size_t parent, size_t count)
+{
+   string name = "f" + to_string(counter++);
+   cout << "make " << place(parent, name) << body(count) << endl;
+   files.push_back({parent, name});
+   return files.size() - 1;
+}
+
+// enter, leave -
+//    cd into a directory made in the current one, and back to /.
+
+void generator::enter(size_t dir)
+{
+   cout << "cd " << place(dirs[dir].parent, dirs[dir].name) << endl;
+   cwd = dir;
+}
+
+void generator::leave()
+{
+   cout << "cd /" << endl;
+   cwd = root;
+}
+
+void generator::build(size_t entries, size_t words)
+{
+   cout << "# build" << endl;
+   if (shape == "wide")
+   {
+      for (size_t index = 0; index < entries / 16; ++index)
+         mkdir(0);
+      for (size_t index = 0; index < entries; ++index)
+         make(0, words);
+   }
+   else if (shape == "deep")
+   {
+      // Walks down the chain as it grows, so that no line names
+      // more than one directory.
+      enter(0);
+      size_t parent = 0;
+      for (size_t index = 0; index < entries; ++index)
+      {
+         parent = mkdir(parent);
+         enter(parent);
+         make(parent, words);
+      }
+      leave();
+   }
+   else if (shape == "random")
+   {
+      for (size_t index = 0; index < entries; ++index)
+      {
+         size_t parent = pick(dirs.size());
+         if (pick(4) == 0)
+            mkdir(parent);
+         else
+            make(parent, 1 + pick(2 * words));
+      }
+   }
+   else if (shape == "small")
+   {
+      size_t parent = 0;
+      for (size_t index = 0; index < entries; ++index)
+      {
+         if (index % 64 == 0)
+            parent = mkdir(0);
+         make(parent, 1);
+      }
+   }
+   else // large
+   {
+      size_t parent = 0;
+      size_t count = max<size_t>(1, entries / 64);
+      for (size_t index = 0; index < count; ++index)
+      {
+         if (index % 4 == 0)
+            parent = mkdir(0);
+         make(parent, 1024 * words);
+      }
+   }
+}
+
+// walk -
+//    Visits a sample of the directories from the root with cd and
+//    ls, cats a sample of the files, and lists the whole tree once.
+
+void generator::walk()
+{
+   cout << "# walk" << endl;
+   for (size_t index = 0; index < min<size_t>(dirs.size(), 256);
+        ++index)
+   {
+      cout << "cd /" << endl;
+      cout << "cd " << path(pick(dirs.size())) << endl;
+      cout << "ls" << endl;
+   }
+   cout << "cd /" << endl;
+   for (size_t index = 0; index < min<size_t>(files.size(), 256);
+        ++index)
+      cout << "cat " << path(files[pick(files.size())]) << endl;
+   cout << "lsr " << top << endl;
+}
+
+// churn -
+//    Makes and removes files in a sample of the directories.
+
+void generator::churn()
+{
+   cout << "# churn" << endl;
+   for (size_t index = 0; index < min<size_t>(dirs.size(), 256);
+        ++index)
+   {
+      size_t file = make(pick(dirs.size()), 4);
+      cout << "rm " << path(files[file]) << endl;
+      files.pop_back();
+   }
+}
+
+// remove -
+//    Removes a sample of the files one at a time, then the rest of
+//    the tree at once.
+
+void generator::remove()
+{
+   cout << "# remove" << endl;
+   shuffle(files.begin(), files.end(), random);
+   files.resize(min<size_t>(files.size(), 256));
+   for (const entry &file : files)
+      cout << "rm " << path(file) << endl;
+   cout << "rmr " << top << endl;
+}
+
+// teardown -
+//    Removes the whole tree with one rmr and starts it again.
+
+void generator::teardown()
+{
+   cout << "# teardown" << endl;
+   cout << "rmr " << top << endl;
+   cout << "mkdir " << top << endl;
+   dirs.assign(1, {root, top});
+   files.clear();
+}
+
+int main(int argc, char **argv)
+{
+   execname(argv[0]);
+   scan_options(argc, argv);
+   if (shape.empty())
+      return exit_status::get();
+   generator script(shape, seed);
+   script.build(entry_count, word_count);
+   if (teardown_only)
+   {
+      script.teardown();
+      script.build(entry_count, word_count);
+      script.teardown();
+      return exit_status::get();
+   }
+   script.walk();
+   script.churn();
+   script.remove();
+   return exit_status::get();
+}
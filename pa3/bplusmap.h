@@ -0,0 +1,204 @@
+// $Id: bplusmap.h,v 1.1 2026-10-19 12:20:00-07 - - $
+
+#ifndef __BPLUSMAP_H__
+#define __BPLUSMAP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "xless.h"
+#include "xpair.h"
+
+//
+// node_keys -
+//    The sorted keys of one node of a bplusmap, and the search among
+//    them.
+// operator[] -
+//    The key at the index.
+// set, shift, take -
+//    Put a key at an index, move the key at one index to another,
+//    and move the key at an index out, leaving the slot to be set.
+// lower -
+//    Index of the first key not less than the key.
+// upper -
+//    Index of the first key greater than the key.
+//
+//    Keys of an arithmetic type under xless are counted without
+//    branches, a loop the compiler may vectorize when optimizing.
+//    Strings under xless also keep the first eight bytes of each key
+//    as a big-endian integer beside the keys.  The integers are
+//    counted the same way, which leaves only the keys that share the
+//    prefix of the key sought to be compared whole, usually none or
+//    one.  Other keys are binary searched.
+//
+
+enum class key_search { binary, counted, prefixed };
+
+template <typename Key, class Less>
+constexpr key_search search_for()
+{
+   if (not is_same<Less, xless<Key>>::value)
+      return key_search::binary;
+   if (is_arithmetic<Key>::value)
+      return key_search::counted;
+   if (is_same<Key, string>::value)
+      return key_search::prefixed;
+   return key_search::binary;
+}
+
+template <typename Key, size_t size>
+struct key_array
+{
+   Key keys[size];
+   const Key &operator[](size_t index) const { return keys[index]; }
+   void set(size_t index, Key key) { keys[index] = move(key); }
+   void shift(size_t to, size_t from) { keys[to] = move(keys[from]); }
+   Key take(size_t index) { return move(keys[index]); }
+};
+
+template <typename Key, class Less, size_t size,
+          key_search = search_for<Key, Less>()>
+struct node_keys : key_array<Key, size>
+{
+   size_t lower(const Less &less, size_t count, const Key &key) const;
+   size_t upper(const Less &less, size_t count, const Key &key) const;
+};
+
+template <typename Key, class Less, size_t size>
+struct node_keys<Key, Less, size, key_search::counted>
+    : key_array<Key, size>
+{
+   size_t lower(const Less &less, size_t count, const Key &key) const;
+   size_t upper(const Less &less, size_t count, const Key &key) const;
+};
+
+template <class Less, size_t size>
+struct node_keys<string, Less, size, key_search::prefixed>
+    : key_array<string, size>
+{
+   uint64_t prefixes[size];
+   static uint64_t prefix(const string &key);
+   void prefix_range(size_t count, uint64_t want, size_t &low,
+                     size_t &high) const;
+   void set(size_t index, string key);
+   void shift(size_t to, size_t from);
+   size_t lower(const Less &less, size_t count,
+                const string &key) const;
+   size_t upper(const Less &less, size_t count,
+                const string &key) const;
+};
+
+//
+// bplusmap -
+//    A map with the interface of listmap, kept as a B+tree.  Inner
+//    nodes hold only keys and children.  The entries are in the
+//    leaves, each a pair of sorted arrays of keys and of entries,
+//    and the leaves are linked in order for iteration, so a find
+//    touches a few cache lines per level and a scan streams through
+//    whole leaves.  A leaf that empties is freed at once rather than
+//    merged, so a tree is never taller than its largest size made
+//    it.  Insert and erase invalidate iterators into the leaves they
+//    change.
+//
+
+template <typename Key, typename Value, class Less = xless<Key>>
+class bplusmap
+{
+public:
+   using key_type = Key;
+   using mapped_type = Value;
+   using value_type = xpair<const key_type, mapped_type>;
+   static constexpr size_t leaf_size = 32;
+   static constexpr size_t inner_size = 32;
+
+private:
+   using leaf_keys = node_keys<Key, Less, leaf_size>;
+   using inner_keys = node_keys<Key, Less, inner_size>;
+   struct node
+   {
+      size_t count{0};
+   };
+   struct leaf;
+   struct chain : node
+   {
+      leaf *next{};
+      leaf *prev{};
+      chain(leaf *next_, leaf *prev_) : next(next_), prev(prev_) {}
+   };
+   struct leaf : chain
+   {
+      leaf_keys keys;
+      alignas(value_type) unsigned char
+          slots[leaf_size * sizeof(value_type)];
+      leaf(leaf *next_, leaf *prev_) : chain(next_, prev_) {}
+      value_type *values()
+      {
+         return reinterpret_cast<value_type *>(slots);
+      }
+   };
+   struct inner : node
+   {
+      inner_keys keys;
+      node *children[inner_size + 1];
+   };
+   struct step
+   {
+      inner *where;
+      size_t child;
+   };
+   // Ample for any tree that fits in memory.
+   static constexpr size_t max_height = 32;
+
+   Less less;
+   node *root{nullptr};
+   size_t height{0};
+   leaf *anchor() { return static_cast<leaf *>(&anchor_); }
+   chain anchor_{anchor(), anchor()};
+   leaf *descend(const key_type &key, step *path);
+   static void place(leaf *where, size_t pos, const value_type &pair);
+   static void take(leaf *where, size_t pos);
+   leaf *split(leaf *full);
+   void add_child(step *path, size_t depth, const key_type &key,
+                  node *child);
+   void drop_child(step *path, size_t depth);
+   void destroy(node *top, size_t level);
+
+public:
+   class iterator;
+   bplusmap(){};
+   bplusmap(const bplusmap &) = delete;
+   bplusmap &operator=(const bplusmap &) = delete;
+   ~bplusmap();
+   iterator insert(const value_type &);
+   iterator find(const key_type &);
+   iterator erase(iterator position);
+   void clear();
+   iterator begin() { return iterator(anchor()->next, 0); }
+   iterator end() { return iterator(anchor(), 0); }
+   bool empty() { return begin() == end(); }
+};
+
+template <typename Key, typename Value, class Less>
+class bplusmap<Key, Value, Less>::iterator
+{
+private:
+   friend class bplusmap<Key, Value, Less>;
+   bplusmap<Key, Value, Less>::leaf *where{nullptr};
+   size_t pos{0};
+   iterator(leaf *where_, size_t pos_) : where(where_), pos(pos_){};
+
+public:
+   iterator(){};
+   value_type &operator*();
+   value_type *operator->();
+   iterator &operator++(); //++itor
+   iterator &operator--(); //--itor
+   bool operator==(const iterator &) const;
+   bool operator!=(const iterator &) const;
+};
+
+#include "bplusmap.tcc"
+#endif
@@ -0,0 +1,630 @@
+// $Id: bplusmap.tcc,v 1.1 2026-10-19 12:20:00-07 - - $
+
+#include <new>
+#include <utility>
+
+#include "bplusmap.h"
+#include "debug.h"
+
+//
+/////////////////////////////////////////////////////////////////
+// Operations on node_keys.
+/////////////////////////////////////////////////////////////////
+//
+
+//
+// size_t node_keys::lower (less, count, key)
+//
+template <typename Key, class Less, size_t size, key_search kind>
+size_t node_keys<Key, Less, size, kind>::lower(const Less &less,
+                                               size_t count,
+                                               const Key &key) const
+{
+   size_t low = 0;
+   size_t high = count;
+   while (low < high)
+   {
+      size_t mid = low + (high - low) / 2;
+      if (less(this->keys[mid], key))
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   return low;
+}
+
+//
+// size_t node_keys::upper (less, count, key)
+//
+template <typename Key, class Less, size_t size, key_search kind>
+size_t node_keys<Key, Less, size, kind>::upper(const Less &less,
+                                               size_t count,
+                                               const Key &key) const
+{
+   size_t low = 0;
+   size_t high = count;
+   while (low < high)
+   {
+      size_t mid = low + (high - low) / 2;
+      if (less(key, this->keys[mid]))
+         high = mid;
+      else
+         low = mid + 1;
+   }
+   return low;
+}
+
+//
+// size_t node_keys<counted>::lower (less, count, key)
+//
+template <typename Key, class Less, size_t size>
+size_t node_keys<Key, Less, size, key_search::counted>::lower(
+    const Less &less, size_t count, const Key &key) const
+{
+   size_t below = 0;
+   for (size_t index = 0; index < count; ++index)
+      below += less(this->keys[index], key);
+   return below;
+}
+
+//
+// size_t node_keys<counted>::upper (less, count, key)
+//
+template <typename Key, class Less, size_t size>
+size_t node_keys<Key, Less, size, key_search::counted>::upper(
+    const Less &less, size_t count, const Key &key) const
+{
+   size_t below = 0;
+   for (size_t index = 0; index < count; ++index)
+      below += not less(key, this->keys[index]);
+   return below;
+}
+
+//
+// uint64_t node_keys<prefixed>::prefix (const string&)
+//
+// The first eight bytes of the key, unsigned and padded with zeros,
+// so that a smaller prefix means a smaller key, as string compares.
+//
+template <class Less, size_t size>
+uint64_t node_keys<string, Less, size, key_search::prefixed>::prefix(
+    const string &key)
+{
+   uint64_t word = 0;
+   size_t length = min<size_t>(key.size(), sizeof word);
+   for (size_t index = 0; index < length; ++index)
+      word |= static_cast<uint64_t>(
+                  static_cast<unsigned char>(key[index]))
+              << (8 * (sizeof word - 1 - index));
+   return word;
+}
+
+//
+// void node_keys<prefixed>::set (size_t, string)
+//
+template <class Less, size_t size>
+void node_keys<string, Less, size, key_search::prefixed>::set(
+    size_t index, string key)
+{
+   prefixes[index] = prefix(key);
+   this->keys[index] = move(key);
+}
+
+//
+// void node_keys<prefixed>::shift (size_t, size_t)
+//
+template <class Less, size_t size>
+void node_keys<string, Less, size, key_search::prefixed>::shift(
+    size_t to, size_t from)
+{
+   prefixes[to] = prefixes[from];
+   this->keys[to] = move(this->keys[from]);
+}
+
+//
+// void node_keys<prefixed>::prefix_range (count, want, low, high)
+//
+// Sets low and high to the number of prefixes below and not above
+// the one wanted.  If every key in the node has the same prefix,
+// as when all of them start alike, counting would tell nothing.
+//
+template <class Less, size_t size>
+void node_keys<string, Less, size, key_search::prefixed>::
+    prefix_range(size_t count, uint64_t want, size_t &low,
+                 size_t &high) const
+{
+   low = 0;
+   high = 0;
+   if (count > 0 and prefixes[0] == prefixes[count - 1])
+   {
+      low = prefixes[0] < want ? count : 0;
+      high = prefixes[0] <= want ? count : 0;
+      return;
+   }
+   for (size_t index = 0; index < count; ++index)
+   {
+      low += prefixes[index] < want;
+      high += prefixes[index] <= want;
+   }
+}
+
+//
+// size_t node_keys<prefixed>::lower (less, count, key)
+//
+// Finds the keys that share the prefix of the key, then binary
+// searches only those.
+//
+template <class Less, size_t size>
+size_t node_keys<string, Less, size, key_search::prefixed>::lower(
+    const Less &less, size_t count, const string &key) const
+{
+   size_t low = 0;
+   size_t high = 0;
+   prefix_range(count, prefix(key), low, high);
+   while (low < high)
+   {
+      size_t mid = low + (high - low) / 2;
+      if (less(this->keys[mid], key))
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   return low;
+}
+
+//
+// size_t node_keys<prefixed>::upper (less, count, key)
+//
+template <class Less, size_t size>
+size_t node_keys<string, Less, size, key_search::prefixed>::upper(
+    const Less &less, size_t count, const string &key) const
+{
+   size_t low = 0;
+   size_t high = 0;
+   prefix_range(count, prefix(key), low, high);
+   while (low < high)
+   {
+      size_t mid = low + (high - low) / 2;
+      if (less(key, this->keys[mid]))
+         high = mid;
+      else
+         low = mid + 1;
+   }
+   return low;
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// Operations on the nodes of bplusmap.
+/////////////////////////////////////////////////////////////////
+//
+
+//
+// leaf* bplusmap::descend (const key_type&, step*)
+//
+// Finds the leaf where the key belongs, recording the inner nodes
+// passed and the child taken from each in path, unless it is null.
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::leaf *
+bplusmap<Key, Value, Less>::descend(const key_type &key, step *path)
+{
+   node *cur = root;
+   for (size_t depth = 0; depth + 1 < height; ++depth)
+   {
+      inner *branch = static_cast<inner *>(cur);
+      size_t child = branch->keys.upper(less, branch->count, key);
+      if (path != nullptr)
+         path[depth] = {branch, child};
+      cur = branch->children[child];
+   }
+   return static_cast<leaf *>(cur);
+}
+
+//
+// void bplusmap::place (leaf*, size_t, const value_type&)
+//
+// Opens a gap at pos in a leaf that is not full and puts the pair
+// in it.
+//
+template <typename Key, typename Value, class Less>
+void bplusmap<Key, Value, Less>::place(leaf *where, size_t pos,
+                                       const value_type &pair)
+{
+   value_type *values = where->values();
+   for (size_t index = where->count; index > pos; --index)
+   {
+      new (&values[index]) value_type(move(values[index - 1]));
+      values[index - 1].~value_type();
+      where->keys.shift(index, index - 1);
+   }
+   new (&values[pos]) value_type(pair);
+   where->keys.set(pos, pair.first);
+   ++where->count;
+}
+
+//
+// void bplusmap::take (leaf*, size_t)
+//
+// Destroys the pair at pos and closes the gap.
+//
+template <typename Key, typename Value, class Less>
+void bplusmap<Key, Value, Less>::take(leaf *where, size_t pos)
+{
+   value_type *values = where->values();
+   values[pos].~value_type();
+   for (size_t index = pos; index + 1 < where->count; ++index)
+   {
+      new (&values[index]) value_type(move(values[index + 1]));
+      values[index + 1].~value_type();
+      where->keys.shift(index, index + 1);
+   }
+   --where->count;
+}
+
+//
+// leaf* bplusmap::split (leaf*)
+//
+// Moves the upper half of a full leaf into a new leaf linked after
+// it, and returns the new leaf.
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::leaf *
+bplusmap<Key, Value, Less>::split(leaf *full)
+{
+   leaf *right = new leaf(full->next, full);
+   full->next->prev = right;
+   full->next = right;
+   size_t half = full->count / 2;
+   value_type *from = full->values();
+   value_type *to = right->values();
+   for (size_t index = half; index < full->count; ++index)
+   {
+      new (&to[index - half]) value_type(move(from[index]));
+      from[index].~value_type();
+      right->keys.set(index - half, full->keys.take(index));
+   }
+   right->count = full->count - half;
+   full->count = half;
+   return right;
+}
+
+//
+// void bplusmap::add_child (step*, size_t, const key_type&, node*)
+//
+// Adds a node made by a split at the given depth to the right of
+// the node it split from, with the key as their separator.  Splits
+// full inner nodes on the way up, and adds a level if the root
+// splits.
+//
+template <typename Key, typename Value, class Less>
+void bplusmap<Key, Value, Less>::add_child(step *path, size_t depth,
+                                           const key_type &key,
+                                           node *child)
+{
+   key_type separator = key;
+   for (;;)
+   {
+      if (depth == 0)
+      {
+         inner *top = new inner;
+         top->count = 1;
+         top->keys.set(0, move(separator));
+         top->children[0] = root;
+         top->children[1] = child;
+         root = top;
+         ++height;
+         return;
+      }
+      inner *branch = path[depth - 1].where;
+      size_t at = path[depth - 1].child;
+      if (branch->count < inner_size)
+      {
+         for (size_t index = branch->count; index > at; --index)
+         {
+            branch->keys.shift(index, index - 1);
+            branch->children[index + 1] = branch->children[index];
+         }
+         branch->keys.set(at, move(separator));
+         branch->children[at + 1] = child;
+         ++branch->count;
+         return;
+      }
+
+      // Lay out the keys and children as if there were room, then
+      // keep the lower half, push up the middle key and move the
+      // rest into a new node.
+      key_type keys[inner_size + 1];
+      node *children[inner_size + 2];
+      for (size_t index = 0, from = 0; index <= inner_size; ++index)
+         keys[index] = index == at ? move(separator)
+                                   : branch->keys.take(from++);
+      for (size_t index = 0, from = 0; index <= inner_size + 1;
+           ++index)
+         children[index] = index == at + 1 ? child
+                                           : branch->children[from++];
+      size_t mid = (inner_size + 1) / 2;
+      inner *right = new inner;
+      for (size_t index = 0; index < mid; ++index)
+      {
+         branch->keys.set(index, move(keys[index]));
+         branch->children[index] = children[index];
+      }
+      branch->children[mid] = children[mid];
+      branch->count = mid;
+      for (size_t index = mid + 1; index <= inner_size; ++index)
+      {
+         right->keys.set(index - mid - 1, move(keys[index]));
+         right->children[index - mid - 1] = children[index];
+      }
+      right->children[inner_size - mid] = children[inner_size + 1];
+      right->count = inner_size - mid;
+      separator = move(keys[mid]);
+      child = right;
+      --depth;
+   }
+}
+
+//
+// void bplusmap::drop_child (step*, size_t)
+//
+// Removes the node at the given depth, which has been freed, from
+// its parent, freeing parents left with no children, and lowers
+// the tree while the root has only one child.
+//
+template <typename Key, typename Value, class Less>
+void bplusmap<Key, Value, Less>::drop_child(step *path, size_t depth)
+{
+   for (;; --depth)
+   {
+      if (depth == 0)
+      {
+         root = nullptr;
+         height = 0;
+         return;
+      }
+      inner *branch = path[depth - 1].where;
+      size_t at = path[depth - 1].child;
+      if (branch->count == 0)
+      {
+         delete branch;
+         continue;
+      }
+      for (size_t index = at == 0 ? 0 : at - 1;
+           index + 1 < branch->count; ++index)
+         branch->keys.shift(index, index + 1);
+      for (size_t index = at; index < branch->count; ++index)
+         branch->children[index] = branch->children[index + 1];
+      --branch->count;
+      break;
+   }
+   while (height > 1 && root->count == 0)
+   {
+      inner *top = static_cast<inner *>(root);
+      root = top->children[0];
+      delete top;
+      --height;
+   }
+}
+
+//
+// void bplusmap::destroy (node*, size_t)
+//
+template <typename Key, typename Value, class Less>
+void bplusmap<Key, Value, Less>::destroy(node *top, size_t level)
+{
+   if (level == 1)
+   {
+      leaf *where = static_cast<leaf *>(top);
+      for (size_t index = 0; index < where->count; ++index)
+         where->values()[index].~value_type();
+      delete where;
+      return;
+   }
+   inner *branch = static_cast<inner *>(top);
+   for (size_t index = 0; index <= branch->count; ++index)
+      destroy(branch->children[index], level - 1);
+   delete branch;
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// Operations on bplusmap.
+/////////////////////////////////////////////////////////////////
+//
+
+//
+// bplusmap::~bplusmap()
+//
+template <typename Key, typename Value, class Less>
+bplusmap<Key, Value, Less>::~bplusmap()
+{
+   DEBUGF('l', reinterpret_cast<const void *>(this));
+   clear();
+}
+
+//
+// void bplusmap::clear()
+//
+template <typename Key, typename Value, class Less>
+void bplusmap<Key, Value, Less>::clear()
+{
+   DEBUGF('l', reinterpret_cast<const void *>(this));
+   if (root != nullptr)
+      destroy(root, height);
+   root = nullptr;
+   height = 0;
+   anchor()->next = anchor();
+   anchor()->prev = anchor();
+}
+
+//
+// iterator bplusmap::insert (const value_type&)
+//
+// Replaces the value if the key is already there.
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::iterator
+bplusmap<Key, Value, Less>::insert(const value_type &pair)
+{
+   DEBUGF('l', &pair << "->" << pair);
+   if (root == nullptr)
+   {
+      leaf *first = new leaf(anchor(), anchor());
+      anchor()->next = first;
+      anchor()->prev = first;
+      root = first;
+      height = 1;
+   }
+   step path[max_height];
+   leaf *where = descend(pair.first, path);
+   size_t pos = where->keys.lower(less, where->count, pair.first);
+   if (pos < where->count and not less(pair.first, where->keys[pos]))
+   {
+      where->values()[pos].second = pair.second;
+      return iterator(where, pos);
+   }
+   if (where->count == leaf_size)
+   {
+      leaf *right = split(where);
+      add_child(path, height - 1, right->keys[0], right);
+      if (pos > where->count)
+      {
+         pos -= where->count;
+         where = right;
+      }
+   }
+   place(where, pos, pair);
+   return iterator(where, pos);
+}
+
+//
+// bplusmap::find(const key_type&)
+//
+// Returns end() unless the key is there.
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::iterator
+bplusmap<Key, Value, Less>::find(const key_type &that)
+{
+   DEBUGF('l', that);
+   if (root == nullptr)
+      return end();
+   leaf *where = descend(that, nullptr);
+   size_t pos = where->keys.lower(less, where->count, that);
+   if (pos == where->count or less(that, where->keys[pos]))
+      return end();
+   return iterator(where, pos);
+}
+
+//
+// iterator bplusmap::erase (iterator position)
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::iterator
+bplusmap<Key, Value, Less>::erase(iterator position)
+{
+   DEBUGF('l', &*position);
+   leaf *where = position.where;
+   size_t pos = position.pos;
+   if (where->count > 1)
+   {
+      take(where, pos);
+      if (pos < where->count)
+         return iterator(where, pos);
+      return iterator(where->next, 0);
+   }
+
+   // The last pair in the leaf goes, and the leaf with it.
+   step path[max_height];
+   descend(where->keys[pos], path);
+   take(where, pos);
+   leaf *next = where->next;
+   where->prev->next = next;
+   next->prev = where->prev;
+   delete where;
+   drop_child(path, height - 1);
+   return iterator(next, 0);
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// Operations on bplusmap::iterator.
+/////////////////////////////////////////////////////////////////
+//
+
+//
+// bplusmap::value_type& bplusmap::iterator::operator*()
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::value_type &
+    bplusmap<Key, Value, Less>::iterator::operator*()
+{
+   DEBUGF('l', where << "[" << pos << "]");
+   return where->values()[pos];
+}
+
+//
+// bplusmap::value_type* bplusmap::iterator::operator->()
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::value_type *
+    bplusmap<Key, Value, Less>::iterator::operator->()
+{
+   DEBUGF('l', where << "[" << pos << "]");
+   return &where->values()[pos];
+}
+
+//
+// bplusmap::iterator& bplusmap::iterator::operator++()
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::iterator &
+bplusmap<Key, Value, Less>::iterator::operator++()
+{
+   DEBUGF('l', where << "[" << pos << "]");
+   if (++pos >= where->count)
+   {
+      where = where->next;
+      pos = 0;
+   }
+   return *this;
+}
+
+//
+// bplusmap::iterator& bplusmap::iterator::operator--()
+//
+template <typename Key, typename Value, class Less>
+typename bplusmap<Key, Value, Less>::iterator &
+bplusmap<Key, Value, Less>::iterator::operator--()
+{
+   DEBUGF('l', where << "[" << pos << "]");
+   if (pos > 0)
+      --pos;
+   else
+   {
+      where = where->prev;
+      pos = where->count == 0 ? 0 : where->count - 1;
+   }
+   return *this;
+}
+
+//
+// bool bplusmap::iterator::operator== (const iterator&)
+//
+template <typename Key, typename Value, class Less>
+inline bool bplusmap<Key, Value, Less>::iterator::operator==(
+    const iterator &that) const
+{
+   return this->where == that.where and this->pos == that.pos;
+}
+
+//
+// bool bplusmap::iterator::operator!= (const iterator&)
+//
+template <typename Key, typename Value, class Less>
+inline bool bplusmap<Key, Value, Less>::iterator::operator!=(
+    const iterator &that) const
+{
+   return not(*this == that);
+}
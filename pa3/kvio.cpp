@@ -0,0 +1,190 @@
+// $Id: kvio.cpp,v 1.1 2026-10-19 13:40:00-07 - - $
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "kvio.h"
+#include "util.h"
+
+//
+/////////////////////////////////////////////////////////////////
+// line_reader
+/////////////////////////////////////////////////////////////////
+//
+
+line_reader::line_reader(const string &filename)
+{
+   fd = filename == "-" ? STDIN_FILENO
+                        : open(filename.c_str(), O_RDONLY);
+   if (fd < 0)
+      return;
+   struct stat info;
+   if (fstat(fd, &info) == 0 and S_ISREG(info.st_mode) and
+       info.st_size > 0)
+   {
+      void *mapped = mmap(nullptr, info.st_size, PROT_READ,
+                          MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED)
+      {
+         madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+         map = static_cast<const char *>(mapped);
+         map_size = info.st_size;
+         end = map_size;
+         at_eof = true;
+         return;
+      }
+   }
+   block.resize(block_size);
+}
+
+line_reader::~line_reader()
+{
+   if (map != nullptr)
+      munmap(const_cast<char *>(map), map_size);
+   if (fd > STDIN_FILENO)
+      close(fd);
+}
+
+//
+// bool line_reader::fill()
+//
+// Moves the unread part of the block to the front, grows the block
+// if it is full, and reads more after it.  False at end of file.
+//
+bool line_reader::fill()
+{
+   if (at_eof)
+      return false;
+   if (begin > 0)
+   {
+      memmove(block.data(), block.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+   }
+   if (end == block.size())
+      block.resize(2 * block.size());
+   for (;;)
+   {
+      ssize_t count =
+          read(fd, block.data() + end, block.size() - end);
+      if (count > 0)
+      {
+         end += count;
+         return true;
+      }
+      if (count < 0 and errno == EINTR)
+         continue;
+      if (count < 0)
+         syscall_error("read");
+      at_eof = true;
+      return false;
+   }
+}
+
+//
+// bool line_reader::next (string_view&)
+//
+bool line_reader::next(string_view &line)
+{
+   const char *base = map != nullptr ? map : block.data();
+   size_t searched = begin;
+   for (;;)
+   {
+      const void *newline =
+          memchr(base + searched, '\n', end - searched);
+      if (newline != nullptr)
+      {
+         size_t stop = static_cast<const char *>(newline) - base;
+         line = string_view(base + begin, stop - begin);
+         begin = stop + 1;
+         return true;
+      }
+      searched = end - begin;
+      // fill may grow the block even when it then finds the end.
+      bool more = fill();
+      base = map != nullptr ? map : block.data();
+      if (not more)
+         break;
+   }
+   if (begin == end)
+      return false;
+   line = string_view(base + begin, end - begin);
+   begin = end;
+   return true;
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// line_writer
+/////////////////////////////////////////////////////////////////
+//
+
+//
+// void write_all (int, string_view)
+//
+// Writes all of the text, however many calls it takes.
+//
+static void write_all(int fd, string_view text)
+{
+   size_t done = 0;
+   while (done < text.size())
+   {
+      ssize_t count =
+          write(fd, text.data() + done, text.size() - done);
+      if (count < 0 and errno == EINTR)
+         continue;
+      if (count < 0)
+      {
+         syscall_error("write");
+         return;
+      }
+      done += count;
+   }
+}
+
+line_writer::line_writer(int fd_) : fd(fd_)
+{
+   block.reserve(block_size);
+}
+
+line_writer &line_writer::operator<<(string_view text)
+{
+   if (fd >= 0 and block.size() + text.size() > block_size)
+   {
+      flush();
+      if (text.size() >= block_size)
+      {
+         write_all(fd, text);
+         return *this;
+      }
+   }
+   block.append(text);
+   return *this;
+}
+
+line_writer &line_writer::operator<<(char chr)
+{
+   return *this << string_view(&chr, 1);
+}
+
+line_writer &line_writer::operator<<(size_t number)
+{
+   char digits[24];
+   auto result = to_chars(digits, digits + sizeof digits, number);
+   return *this << string_view(digits, result.ptr - digits);
+}
+
+void line_writer::flush()
+{
+   if (fd < 0)
+      return;
+   write_all(fd, block);
+   block.clear();
+}
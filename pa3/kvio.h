@@ -0,0 +1,87 @@
+// $Id: kvio.h,v 1.1 2026-10-19 13:40:00-07 - - $
+
+//
+// kvio -
+//    Line input and buffered output for keyvalue, straight on file
+//    descriptors rather than through iostreams.
+//
+
+#ifndef __KVIO_H__
+#define __KVIO_H__
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//
+// line_reader -
+//    Hands out the lines of a file, or of the standard input if the
+//    name is "-", as views without their newlines.  A view is good
+//    only until the next call to next.  A regular file is mapped
+//    into memory whole and its lines are views into the map.
+//    Anything else is read in blocks, and a line that does not fit
+//    in the block grows it.  The last line need not end with a
+//    newline, and an empty file has no lines.
+//
+//    If the file can not be opened, the reader is false and errno
+//    says why.
+//
+
+class line_reader
+{
+private:
+   static constexpr size_t block_size = 65536;
+   int fd{-1};
+   const char *map{nullptr};
+   size_t map_size{0};
+   vector<char> block;
+   size_t begin{0};
+   size_t end{0};
+   bool at_eof{false};
+   bool fill();
+
+public:
+   explicit line_reader(const string &filename);
+   line_reader(const line_reader &) = delete;
+   line_reader &operator=(const line_reader &) = delete;
+   ~line_reader();
+   explicit operator bool() const { return fd >= 0; }
+   bool next(string_view &line);
+};
+
+//
+// line_writer -
+//    Collects output in a block and writes it to a file descriptor
+//    when the block fills, when flush is called, and when the
+//    writer is destroyed.  A writer made without a file descriptor
+//    keeps all of its output in memory, for text to return.
+//
+
+class line_writer
+{
+private:
+   static constexpr size_t block_size = 65536;
+   int fd{-1};
+   string block;
+
+public:
+   line_writer() {}
+   explicit line_writer(int fd_);
+   line_writer(const line_writer &) = delete;
+   line_writer(line_writer &&that)
+       : fd(that.fd), block(move(that.block)) { that.fd = -1; }
+   line_writer &operator=(const line_writer &) = delete;
+   ~line_writer() { flush(); }
+   line_writer &operator<<(string_view text);
+   line_writer &operator<<(char chr);
+   line_writer &operator<<(size_t number);
+   void flush();
+   string_view text() const { return block; }
+   void clear() { string().swap(block); }
+};
+
+#endif
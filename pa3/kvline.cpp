@@ -0,0 +1,84 @@
+// $Id: kvline.cpp,v 1.1 2026-10-19 13:10:00-07 - - $
+
+#include "kvline.h"
+
+static bool is_space(char chr)
+{
+   switch (chr)
+   {
+   case ' ':
+   case '\t':
+   case '\n':
+   case '\v':
+   case '\f':
+   case '\r':
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool has_break(string_view text)
+{
+   return text.find_first_of("\r\n") != string_view::npos;
+}
+
+//
+// Trims white space from both ends of the text into part, and
+// says whether . could match what is left.
+//
+static bool trim(string_view text, string_view &part)
+{
+   size_t begin = 0;
+   size_t end = text.size();
+   while (begin < end and is_space(text[begin]))
+      ++begin;
+   while (end > begin and is_space(text[end - 1]))
+      --end;
+   part = text.substr(begin, end - begin);
+   return not has_break(part);
+}
+
+//
+// kvline scan_kvline (string_view)
+//
+// The key runs to the first = that leaves a key and a value with no
+// break inside them.  A later = is part of the value.
+//
+kvline scan_kvline(string_view line)
+{
+   kvline result;
+   size_t start = 0;
+   while (start < line.size() and is_space(line[start]))
+      ++start;
+   if (start == line.size() or
+       (line[start] == '#' and not has_break(line.substr(start))))
+   {
+      result.kind = kv_kind::comment;
+      return result;
+   }
+   size_t equals = line.find('=', start);
+   if (equals == string_view::npos)
+   {
+      trim(line.substr(start), result.key);
+      result.kind = kv_kind::find_key;
+      return result;
+   }
+   for (; equals != string_view::npos;
+        equals = line.find('=', equals + 1))
+   {
+      if (not trim(line.substr(start, equals - start), result.key))
+         break;
+      if (trim(line.substr(equals + 1), result.value))
+      {
+         if (result.key.empty())
+            result.kind = result.value.empty() ? kv_kind::print_all
+                                               : kv_kind::find_value;
+         else
+            result.kind = result.value.empty() ? kv_kind::erase
+                                               : kv_kind::set;
+         return result;
+      }
+   }
+   return kvline();
+}
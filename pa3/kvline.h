@@ -0,0 +1,58 @@
+// $Id: kvline.h,v 1.1 2026-10-19 13:10:00-07 - - $
+
+//
+// kvline -
+//    Splits one line of keyvalue input into its parts in a single
+//    pass, without copying or allocating.  The key and the value
+//    are views into the line, with white space trimmed from both
+//    ends.  White space is what \s matches:  blank, tab, newline,
+//    vertical tab, form feed and return.
+//
+//    The kinds of lines are:
+//
+//    comment -   only white space, or white space then # with no
+//                return or newline after it.
+//    set -       key = value
+//    erase -     key =
+//    find_value - = value
+//    print_all - =
+//    find_key -  key, with no = in it.
+//    invalid -   a line with an = that has a return or a newline
+//                inside the key or the value.
+//
+//    This is what the regular expressions
+//       ^\s*(#.*)?$
+//       ^\s*(.*?)\s*=\s*(.*?)\s*$
+//       ^\s*([^=]+?)\s*$
+//    found when tried in that order, where . matches neither a
+//    return nor a newline, and the key and value are their groups.
+//
+
+#ifndef __KVLINE_H__
+#define __KVLINE_H__
+
+#include <string_view>
+
+using namespace std;
+
+enum class kv_kind
+{
+   comment,
+   set,
+   erase,
+   find_value,
+   print_all,
+   find_key,
+   invalid
+};
+
+struct kvline
+{
+   kv_kind kind{kv_kind::invalid};
+   string_view key;
+   string_view value;
+};
+
+kvline scan_kvline(string_view line);
+
+#endif
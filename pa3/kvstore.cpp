@@ -0,0 +1,599 @@
+// $Id: kvstore.cpp,v 1.1 2026-10-19 14:00:00-07 - - $
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "debug.h"
+#include "kvstore.h"
+#include "util.h"
+
+//
+// Layout of the table, in the byte order of the machine:
+//
+//    magic          8 bytes, "kvtable1"
+//    count          8 bytes
+//    by_key         count offsets of entries, 8 bytes each, in the
+//                   order of their keys
+//    by_value       the same offsets in the order of their values,
+//                   and of their keys among equal values
+//    entries        each a 4-byte key length, a 4-byte value length,
+//                   the key and the value
+//
+// Layout of a record in the log:
+//
+//    checksum       4 bytes, CRC-32 of the rest of the record
+//    op             1 byte, 's' to set a key or 'e' to erase it
+//    key length     4 bytes
+//    value length   4 bytes, 0 for an erase
+//    key, value
+//
+
+static const char table_magic[] = "kvtable1";
+static constexpr size_t table_header = 16;
+static constexpr size_t record_header = 13;
+static constexpr size_t write_block = 1 << 20;
+
+[[noreturn]] static void fail(const string &name)
+{
+   throw kvstore_error(name + ": " + strerror(errno));
+}
+
+static uint32_t crc32(const char *data, size_t size)
+{
+   static const vector<uint32_t> table = []() {
+      vector<uint32_t> entries(256);
+      for (uint32_t index = 0; index < 256; ++index)
+      {
+         uint32_t crc = index;
+         for (int bit = 0; bit < 8; ++bit)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+         entries[index] = crc;
+      }
+      return entries;
+   }();
+   uint32_t crc = 0xFFFFFFFFu;
+   for (size_t index = 0; index < size; ++index)
+      crc = table[(crc ^ static_cast<unsigned char>(data[index])) &
+                  0xFF] ^
+            (crc >> 8);
+   return crc ^ 0xFFFFFFFFu;
+}
+
+template <typename Word>
+static void put_word(string &out, Word word)
+{
+   out.append(reinterpret_cast<const char *>(&word), sizeof word);
+}
+
+template <typename Word>
+static Word get_word(const char *data)
+{
+   Word word;
+   memcpy(&word, data, sizeof word);
+   return word;
+}
+
+static void write_fully(int fd, string_view text, const string &name)
+{
+   while (not text.empty())
+   {
+      ssize_t count = write(fd, text.data(), text.size());
+      if (count < 0 and errno == EINTR)
+         continue;
+      if (count < 0)
+         fail(name);
+      text.remove_prefix(count);
+   }
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// recent_value
+/////////////////////////////////////////////////////////////////
+//
+
+bool operator<(const recent_value &left, const recent_value &right)
+{
+   return left.text < right.text;
+}
+
+bool operator<(const recent_value &left, string_view right)
+{
+   return left.text < right;
+}
+
+bool operator<(string_view left, const recent_value &right)
+{
+   return left < right.text;
+}
+
+ostream &operator<<(ostream &out, const recent_value &value)
+{
+   return value.erased ? out << "(erased)" : out << value.text;
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// kvstore
+/////////////////////////////////////////////////////////////////
+//
+
+kvstore::kvstore(const string &dirname_) : dirname(dirname_)
+{
+   DEBUGF('s', dirname);
+   try
+   {
+      if (mkdir(dirname.c_str(), 0777) < 0 and errno != EEXIST)
+         fail(dirname);
+      dirfd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY);
+      if (dirfd < 0)
+         fail(dirname);
+      if (unlink(filename("table.tmp").c_str()) < 0 and
+          errno != ENOENT)
+         fail(filename("table.tmp"));
+      open_table();
+      logfd = open(filename("log").c_str(),
+                   O_RDWR | O_CREAT | O_APPEND, 0666);
+      if (logfd < 0)
+         fail(filename("log"));
+      replay_log();
+   }
+   catch (...)
+   {
+      close_files();
+      throw;
+   }
+}
+
+kvstore::~kvstore()
+{
+   DEBUGF('s', dirname);
+   try
+   {
+      sync();
+   }
+   catch (kvstore_error &error)
+   {
+      complain() << error.what() << endl;
+   }
+   close_files();
+}
+
+void kvstore::close_files()
+{
+   close_table();
+   if (logfd >= 0)
+      close(logfd);
+   if (dirfd >= 0)
+      close(dirfd);
+   logfd = dirfd = -1;
+}
+
+string kvstore::filename(const char *name) const
+{
+   return dirname + "/" + name;
+}
+
+//
+// void kvstore::open_table()
+//
+// Maps the table into memory, if there is one.
+//
+void kvstore::open_table()
+{
+   string name = filename("table");
+   int fd = open(name.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      if (errno == ENOENT)
+         return;
+      fail(name);
+   }
+   struct stat info;
+   if (fstat(fd, &info) < 0)
+   {
+      close(fd);
+      fail(name);
+   }
+   if (static_cast<size_t>(info.st_size) < table_header)
+   {
+      close(fd);
+      throw kvstore_error(name + ": not a table");
+   }
+   void *mapped =
+       mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mapped == MAP_FAILED)
+      fail(name);
+   table = static_cast<const char *>(mapped);
+   table_size = info.st_size;
+   table_count = table_word(8);
+   if (memcmp(table, table_magic, 8) != 0 or
+       table_count > (table_size - table_header) / 16)
+   {
+      close_table();
+      throw kvstore_error(name + ": not a table");
+   }
+}
+
+void kvstore::close_table()
+{
+   if (table != nullptr)
+      munmap(const_cast<char *>(table), table_size);
+   table = nullptr;
+   table_size = table_count = 0;
+}
+
+//
+// void kvstore::replay_log()
+//
+// Applies each whole record of the log, and cuts the log after the
+// last one.
+//
+void kvstore::replay_log()
+{
+   string name = filename("log");
+   string data;
+   char block[65536];
+   for (;;)
+   {
+      ssize_t count = pread(logfd, block, sizeof block, data.size());
+      if (count < 0 and errno == EINTR)
+         continue;
+      if (count < 0)
+         fail(name);
+      if (count == 0)
+         break;
+      data.append(block, count);
+   }
+   size_t pos = 0;
+   while (pos + record_header <= data.size())
+   {
+      const char *record = data.data() + pos;
+      uint32_t key_size = get_word<uint32_t>(record + 5);
+      uint32_t value_size = get_word<uint32_t>(record + 9);
+      size_t size = record_header + key_size + value_size;
+      if (size > data.size() - pos or
+          crc32(record + 4, size - 4) != get_word<uint32_t>(record))
+         break;
+      string_view key(record + record_header, key_size);
+      string value(record + record_header + key_size, value_size);
+      if (record[4] == 's')
+         recent.insert_or_assign(key, recent_value{move(value)});
+      else if (record[4] == 'e')
+         recent.insert_or_assign(key, recent_value{"", true});
+      else
+         break;
+      pos += size;
+      ++log_records;
+   }
+   DEBUGF('s', log_records << " records, " << data.size() - pos
+                           << " bytes dropped");
+   if (pos < data.size() and
+       (ftruncate(logfd, pos) < 0 or fsync(logfd) < 0))
+      fail(name);
+}
+
+void kvstore::append_log(char op, string_view key, string_view value)
+{
+   size_t start = log_buffer.size();
+   put_word<uint32_t>(log_buffer, 0);
+   log_buffer += op;
+   put_word<uint32_t>(log_buffer, key.size());
+   put_word<uint32_t>(log_buffer, value.size());
+   log_buffer.append(key);
+   log_buffer.append(value);
+   uint32_t crc = crc32(log_buffer.data() + start + 4,
+                        log_buffer.size() - start - 4);
+   memcpy(&log_buffer[start], &crc, sizeof crc);
+   if (log_buffer.size() >= write_block)
+   {
+      write_fully(logfd, log_buffer, filename("log"));
+      log_buffer.clear();
+   }
+}
+
+void kvstore::changed()
+{
+   if (++log_records >= compact_after)
+      compact();
+}
+
+uint64_t kvstore::table_word(size_t offset) const
+{
+   if (offset > table_size or table_size - offset < 8)
+      throw kvstore_error(filename("table") + ": damaged");
+   return get_word<uint64_t>(table + offset);
+}
+
+kvstore::value_type kvstore::table_entry(uint64_t offset) const
+{
+   if (offset > table_size or table_size - offset < 8)
+      throw kvstore_error(filename("table") + ": damaged");
+   uint64_t key_size = get_word<uint32_t>(table + offset);
+   uint64_t value_size = get_word<uint32_t>(table + offset + 4);
+   if (table_size - offset - 8 < key_size + value_size)
+      throw kvstore_error(filename("table") + ": damaged");
+   const char *key = table + offset + 8;
+   return value_type(string_view(key, key_size),
+                     string_view(key + key_size, value_size));
+}
+
+kvstore::value_type kvstore::table_by_key(size_t pos) const
+{
+   return table_entry(table_word(table_header + 8 * pos));
+}
+
+kvstore::value_type kvstore::table_by_value(size_t pos) const
+{
+   return table_entry(
+       table_word(table_header + 8 * (table_count + pos)));
+}
+
+size_t kvstore::table_lower_bound(string_view key) const
+{
+   size_t low = 0;
+   size_t high = table_count;
+   while (low < high)
+   {
+      size_t middle = low + (high - low) / 2;
+      if (table_by_key(middle).first < key)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   return low;
+}
+
+kvstore::iterator kvstore::seek(string_view key)
+{
+   return iterator(this, table_lower_bound(key),
+                   recent.lower_bound(key));
+}
+
+void kvstore::insert_or_assign(string_view key, string_view value)
+{
+   DEBUGF('s', key << " = " << value);
+   append_log('s', key, value);
+   recent.insert_or_assign(key, recent_value{string(value)});
+   changed();
+}
+
+kvstore::iterator kvstore::find(string_view key)
+{
+   DEBUGF('s', key);
+   iterator found = seek(key);
+   if (found != end() and found->first == key)
+      return found;
+   return end();
+}
+
+//
+// vector<iterator> kvstore::find_value (string_view)
+//
+// Merges the keys the table has with the value, less those the log
+// has changed since, with the keys the log has set to it.
+//
+vector<kvstore::iterator> kvstore::find_value(string_view value)
+{
+   DEBUGF('s', value);
+   size_t low = 0;
+   size_t high = table_count;
+   while (low < high)
+   {
+      size_t middle = low + (high - low) / 2;
+      if (table_by_value(middle).second < value)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   vector<string_view> from_table;
+   for (; low < table_count; ++low)
+   {
+      value_type entry = table_by_value(low);
+      if (entry.second != value)
+         break;
+      if (recent.find(entry.first) == recent.end())
+         from_table.push_back(entry.first);
+   }
+   vector<string_view> from_recent;
+   for (auto found : recent.find_value(value))
+      if (not found->second.erased)
+         from_recent.push_back(found->first);
+   vector<string_view> keys(from_table.size() + from_recent.size());
+   merge(from_table.begin(), from_table.end(), from_recent.begin(),
+         from_recent.end(), keys.begin());
+   vector<iterator> found;
+   for (string_view key : keys)
+      found.push_back(find(key));
+   return found;
+}
+
+void kvstore::erase(iterator position)
+{
+   string key(position->first);
+   DEBUGF('s', key);
+   append_log('e', key, "");
+   recent.insert_or_assign(key, recent_value{"", true});
+   changed();
+}
+
+kvstore::iterator kvstore::begin()
+{
+   return iterator(this, 0, recent.begin());
+}
+
+kvstore::iterator kvstore::end()
+{
+   return iterator(this, table_count, recent.end());
+}
+
+//
+// void kvstore::sync()
+//
+// Writes out the log and waits for it to reach the disk.
+//
+void kvstore::sync()
+{
+   write_fully(logfd, log_buffer, filename("log"));
+   log_buffer.clear();
+   if (fdatasync(logfd) < 0)
+      fail(filename("log"));
+}
+
+//
+// void kvstore::compact()
+//
+// Writes every entry to a new table, puts it in place of the old
+// one, and then empties the log.
+//
+void kvstore::compact()
+{
+   DEBUGF('s', dirname << ": " << log_records << " records");
+   vector<value_type> entries;
+   for (iterator itor = begin(); itor != end(); ++itor)
+      entries.push_back(*itor);
+   vector<size_t> by_value(entries.size());
+   iota(by_value.begin(), by_value.end(), 0);
+   stable_sort(by_value.begin(), by_value.end(),
+               [&entries](size_t left, size_t right) {
+                  return entries[left].second < entries[right].second;
+               });
+   vector<uint64_t> offsets;
+   uint64_t offset = table_header + 16 * entries.size();
+   for (const value_type &entry : entries)
+   {
+      offsets.push_back(offset);
+      offset += 8 + entry.first.size() + entry.second.size();
+   }
+
+   string name = filename("table.tmp");
+   int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (fd < 0)
+      fail(name);
+   try
+   {
+      string out(table_magic, 8);
+      put_word<uint64_t>(out, entries.size());
+      for (uint64_t entry_offset : offsets)
+         put_word<uint64_t>(out, entry_offset);
+      for (size_t index : by_value)
+         put_word<uint64_t>(out, offsets[index]);
+      for (const value_type &entry : entries)
+      {
+         put_word<uint32_t>(out, entry.first.size());
+         put_word<uint32_t>(out, entry.second.size());
+         out.append(entry.first);
+         out.append(entry.second);
+         if (out.size() >= write_block)
+         {
+            write_fully(fd, out, name);
+            out.clear();
+         }
+      }
+      write_fully(fd, out, name);
+      if (fsync(fd) < 0)
+         fail(name);
+   }
+   catch (...)
+   {
+      close(fd);
+      unlink(name.c_str());
+      throw;
+   }
+   close(fd);
+   if (rename(name.c_str(), filename("table").c_str()) < 0)
+      fail(name);
+   if (fsync(dirfd) < 0)
+      fail(dirname);
+
+   close_table();
+   open_table();
+   log_buffer.clear();
+   if (ftruncate(logfd, 0) < 0 or fsync(logfd) < 0)
+      fail(filename("log"));
+   recent.clear();
+   log_records = 0;
+}
+
+//
+/////////////////////////////////////////////////////////////////
+// kvstore::iterator
+/////////////////////////////////////////////////////////////////
+//
+
+kvstore::iterator::iterator(kvstore *store_, size_t table_pos_,
+                            recent_map::iterator recent_pos_)
+    : store(store_), table_pos(table_pos_), recent_pos(recent_pos_)
+{
+   settle();
+}
+
+//
+// void kvstore::iterator::settle()
+//
+// Moves to the lesser key of the table and the log, taking the log's
+// entry when both have the key and skipping an erased one.
+//
+void kvstore::iterator::settle()
+{
+   for (;;)
+   {
+      bool in_table = table_pos < store->table_count;
+      from_recent = recent_pos != store->recent.end();
+      if (not from_recent)
+      {
+         if (in_table)
+            current = store->table_by_key(table_pos);
+         return;
+      }
+      if (in_table)
+      {
+         value_type entry = store->table_by_key(table_pos);
+         if (entry.first < recent_pos->first)
+         {
+            current = entry;
+            from_recent = false;
+            return;
+         }
+         if (entry.first == recent_pos->first)
+            ++table_pos;
+      }
+      if (not recent_pos->second.erased)
+      {
+         current = value_type(recent_pos->first,
+                              recent_pos->second.text);
+         return;
+      }
+      ++recent_pos;
+   }
+}
+
+kvstore::iterator &kvstore::iterator::operator++()
+{
+   if (from_recent)
+      ++recent_pos;
+   else
+      ++table_pos;
+   settle();
+   return *this;
+}
+
+bool kvstore::iterator::operator==(const iterator &that) const
+{
+   return table_pos == that.table_pos and
+          recent_pos == that.recent_pos;
+}
+
+bool kvstore::iterator::operator!=(const iterator &that) const
+{
+   return not(*this == that);
+}
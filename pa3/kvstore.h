@@ -0,0 +1,144 @@
+// $Id: kvstore.h,v 1.1 2026-10-19 14:00:00-07 - - $
+
+//
+// kvstore -
+//    A map from strings to strings kept in a directory, so that it
+//    outlives the program.  It has the part of the listmap interface
+//    that keyvalue uses.
+//
+//    The directory holds two files:
+//
+//    table -  Every entry as of the last compaction, sorted by key,
+//             with a second index sorted by value.  It is mapped
+//             into memory and read in place, never changed.
+//    log -    Each insert and erase since then, appended as a record
+//             with a checksum.  The same changes are kept in memory
+//             in a listmap, with an erase as a marker.
+//
+//    Reads look in the listmap first and then in the table.  After
+//    compact_after records the two are merged into a new table,
+//    which is written beside the old one and renamed over it before
+//    the log is emptied, so a crash at any point leaves either the
+//    old table and its log or the new table and a log whose records
+//    it already holds.  On opening, a partial table is removed and
+//    the log is read up to its first incomplete or damaged record,
+//    and cut there.
+//
+//    sync writes out the log and waits for the disk.  Until then a
+//    crash may lose the most recent changes, but never the ones
+//    before them.
+//
+//    Iterators are forward only, and good until the next insert or
+//    erase.  Errors in the directory's files throw kvstore_error.
+//
+
+#ifndef __KVSTORE_H__
+#define __KVSTORE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "listmap.h"
+#include "xpair.h"
+
+using namespace std;
+
+class kvstore_error : public runtime_error
+{
+public:
+   explicit kvstore_error(const string &what) : runtime_error(what) {}
+};
+
+//
+// recent_value -
+//    What the log says of a key:  its value, or that it was erased.
+//    Ordered by value for the value index of the listmap.
+//
+
+struct recent_value
+{
+   string text;
+   bool erased{false};
+};
+
+bool operator<(const recent_value &left, const recent_value &right);
+bool operator<(const recent_value &left, string_view right);
+bool operator<(string_view left, const recent_value &right);
+ostream &operator<<(ostream &out, const recent_value &value);
+
+class kvstore
+{
+public:
+   using value_type = xpair<string_view, string_view>;
+   class iterator;
+   static constexpr size_t compact_after = 1 << 18;
+
+private:
+   using recent_map = listmap<string, recent_value, xless<string>,
+                              tree_index, value_tree>;
+   string dirname;
+   int dirfd{-1};
+   int logfd{-1};
+   string log_buffer;
+   size_t log_records{0};
+   const char *table{nullptr};
+   size_t table_size{0};
+   size_t table_count{0};
+   recent_map recent;
+   string filename(const char *name) const;
+   void close_files();
+   void open_table();
+   void close_table();
+   void replay_log();
+   void append_log(char op, string_view key, string_view value);
+   void changed();
+   uint64_t table_word(size_t offset) const;
+   value_type table_entry(uint64_t offset) const;
+   value_type table_by_key(size_t pos) const;
+   value_type table_by_value(size_t pos) const;
+   size_t table_lower_bound(string_view key) const;
+   iterator seek(string_view key);
+
+public:
+   explicit kvstore(const string &dirname_);
+   kvstore(const kvstore &) = delete;
+   kvstore &operator=(const kvstore &) = delete;
+   ~kvstore();
+   void insert_or_assign(string_view key, string_view value);
+   iterator find(string_view key);
+   vector<iterator> find_value(string_view value);
+   void erase(iterator position);
+   iterator begin();
+   iterator end();
+   void sync();
+   void compact();
+};
+
+class kvstore::iterator
+{
+private:
+   friend class kvstore;
+   kvstore *store{nullptr};
+   size_t table_pos{0};
+   recent_map::iterator recent_pos;
+   bool from_recent{false};
+   value_type current;
+   iterator(kvstore *store_, size_t table_pos_,
+            recent_map::iterator recent_pos_);
+   void settle();
+
+public:
+   iterator(){};
+   const value_type &operator*() const { return current; }
+   const value_type *operator->() const { return &current; }
+   iterator &operator++(); //++itor
+   bool operator==(const iterator &) const;
+   bool operator!=(const iterator &) const;
+};
+
+#endif
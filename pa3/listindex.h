@@ -0,0 +1,203 @@
+// $Id: listindex.h,v 1.1 2026-10-19 12:10:00-07 - - $
+
+#ifndef __LISTINDEX_H__
+#define __LISTINDEX_H__
+
+#include <memory>
+#include <set>
+
+using namespace std;
+
+//
+// Index policies for listmap.
+//
+// A listmap keeps its nodes in a sorted doubly linked list, which
+// is what its iterators walk.  The index finds where a key belongs
+// in that list.  Each policy is a template over the node type, the
+// comparison and the allocator of the map, is constructed from a
+// comparison and an allocator, and provides:
+//
+// lower_bound (anchor, key) -
+//    The first node whose key is not less than the key, or the
+//    anchor if there is none.
+// insert (node) -
+//    Called after the node has been linked into the list.
+// erase (node) -
+//    Called before the node is unlinked from the list.
+// clear () -
+//    Called when every node is freed at once.
+//
+
+//
+// list_index -
+//    No index at all:  lower_bound walks the list from the front,
+//    so insert and find are linear and loading n keys is quadratic.
+//    Costs nothing per node.
+//
+
+template <typename Node, class Less, class Alloc>
+class list_index
+{
+private:
+   Less less;
+
+public:
+   list_index(const Less &less_, const Alloc &) : less(less_) {}
+   template <typename Key>
+   Node *lower_bound(Node *anchor, const Key &key) const
+   {
+      Node *cur = anchor->next;
+      for (; cur != anchor && less(cur->value.first, key);
+           cur = cur->next)
+         ;
+      return cur;
+   }
+   void insert(Node *) {}
+   void erase(Node *) {}
+   void clear() {}
+};
+
+//
+// tree_index -
+//    A balanced search tree over the nodes, ordered by their keys,
+//    so that insert and find are logarithmic.  Holds pointers to the
+//    nodes, not copies of the keys, in tree nodes taken from the
+//    allocator.
+//
+
+template <typename Node, class Less, class Alloc>
+class tree_index
+{
+private:
+   struct by_key
+   {
+      using is_transparent = void;
+      Less less;
+      bool operator()(Node *left, Node *right) const
+      {
+         return less(left->value.first, right->value.first);
+      }
+      template <typename Key>
+      bool operator()(const Node *left, const Key &right) const
+      {
+         return less(left->value.first, right);
+      }
+      template <typename Key>
+      bool operator()(const Key &left, const Node *right) const
+      {
+         return less(left, right->value.first);
+      }
+   };
+   using tree_alloc = typename allocator_traits<
+       Alloc>::template rebind_alloc<Node *>;
+   set<Node *, by_key, tree_alloc> nodes;
+
+public:
+   tree_index(const Less &less_, const Alloc &alloc)
+       : nodes(by_key{less_}, tree_alloc(alloc)) {}
+   template <typename Key>
+   Node *lower_bound(Node *anchor, const Key &key) const
+   {
+      auto found = nodes.lower_bound(key);
+      return found == nodes.end() ? anchor : *found;
+   }
+   void insert(Node *node) { nodes.insert(node); }
+   void erase(Node *node) { nodes.erase(node); }
+   void clear() { nodes.clear(); }
+};
+
+//
+// Value index policies for listmap.
+//
+// The value index finds the entries that hold a given value.  Each
+// policy is a template and is constructed like an index policy, is
+// told of nodes by insert, erase and clear in the same way, and is
+// also told when a value is replaced:
+//
+// each_with (anchor, value, visit) -
+//    Calls visit with every node whose value equals the value, in
+//    the order of their keys.
+// erase (node), insert (node) -
+//    Called before and after the value of a node is replaced.
+//
+
+//
+// value_scan -
+//    No index at all:  each_with walks the whole list.  Costs
+//    nothing per node.
+//
+
+template <typename Node, class Less, class Alloc>
+class value_scan
+{
+public:
+   value_scan(const Less &, const Alloc &) {}
+   template <typename Other, typename Visit>
+   void each_with(Node *anchor, const Other &value, Visit visit) const
+   {
+      for (Node *cur = anchor->next; cur != anchor; cur = cur->next)
+         if (cur->value.second == value)
+            visit(cur);
+   }
+   void insert(Node *) {}
+   void erase(Node *) {}
+   void clear() {}
+};
+
+//
+// value_tree -
+//    A balanced search tree over the nodes, ordered by their values
+//    and then by their keys, so that each_with is logarithmic plus
+//    the number of nodes found.  Values are compared with operator<.
+//    A value changed through an iterator is not seen by the tree, so
+//    a map with a value_tree must replace values with insert or
+//    insert_or_assign.
+//
+
+template <typename Node, class Less, class Alloc>
+class value_tree
+{
+private:
+   struct by_value
+   {
+      using is_transparent = void;
+      Less less;
+      bool operator()(Node *left, Node *right) const
+      {
+         if (left->value.second < right->value.second)
+            return true;
+         if (right->value.second < left->value.second)
+            return false;
+         return less(left->value.first, right->value.first);
+      }
+      template <typename Value>
+      bool operator()(const Node *left, const Value &right) const
+      {
+         return left->value.second < right;
+      }
+      template <typename Value>
+      bool operator()(const Value &left, const Node *right) const
+      {
+         return left < right->value.second;
+      }
+   };
+   using tree_alloc = typename allocator_traits<
+       Alloc>::template rebind_alloc<Node *>;
+   set<Node *, by_value, tree_alloc> nodes;
+
+public:
+   value_tree(const Less &less_, const Alloc &alloc)
+       : nodes(by_value{less_}, tree_alloc(alloc)) {}
+   template <typename Other, typename Visit>
+   void each_with(Node *, const Other &value, Visit visit) const
+   {
+      auto range = nodes.equal_range(value);
+      for (auto itor = range.first; itor != range.second; ++itor)
+         visit(*itor);
+   }
+   void insert(Node *node) { nodes.insert(node); }
+   void erase(Node *node) { nodes.erase(node); }
+   void clear() { nodes.clear(); }
+};
+
+#endif
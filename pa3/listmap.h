@@ -3,16 +3,63 @@
 #ifndef __LISTMAP_H__
 #define __LISTMAP_H__
 
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "listindex.h"
+#include "nodepool.h"
 #include "xless.h"
 #include "xpair.h"
 
-template <typename Key, typename Value, class Less = xless<Key>>
+//
+// listmap -
+//    A map kept as a sorted doubly linked list, which its iterators
+//    walk in order.  Index chooses how a key is found in the list:
+//    tree_index by default, or list_index to walk the list itself.
+//    See listindex.h.  Values chooses how entries are found by
+//    their values:  value_scan by default, which walks the list, or
+//    value_tree to keep them in a second tree.  Alloc provides the
+//    memory for the nodes and for each index.  By default that is
+//    three node_pools owned by the map, one for the list and one for
+//    each index, since a node_pool serves objects of one size and a
+//    rebound one starts empty.  An index that keeps no tree never
+//    takes a slab from its pool.  Erased nodes are reused, and every
+//    slab is returned at once when the map is destroyed.
+//
+// insert -
+//    Adds the pair, or replaces the value if the key is there.
+// emplace -
+//    Builds a pair from the arguments and adds it unless its key is
+//    there.  True with the iterator if it was added.
+// try_emplace -
+//    Unless the key is there, adds it with a value built from the
+//    arguments.  Nothing is built if the key is there.
+// insert_or_assign -
+//    Adds the key with the value, or assigns the value if the key
+//    is there, building the key only if it is new.  The key may be
+//    of any type Less can compare with key_type.
+// find -
+//    The entry with the key, or end().  With a transparent Less,
+//    such as xless, the key may be of any type Less can compare with
+//    key_type, so a string_view finds a string key without a copy.
+// lower_bound -
+//    The first entry whose key is not less than the key, or end().
+// find_value -
+//    Every entry with the value, in the order of their keys.
+//
+
+template <typename Key, typename Value, class Less = xless<Key>,
+          template <typename, class, class> class Index = tree_index,
+          template <typename, class, class> class Values = value_scan,
+          class Alloc = node_pool<xpair<const Key, Value>>>
 class listmap
 {
 public:
    using key_type = Key;
    using mapped_type = Value;
    using value_type = xpair<const key_type, mapped_type>;
+   class iterator;
 
 private:
    Less less;
@@ -26,31 +73,63 @@ private:
    struct node : link
    {
       value_type value{};
-      node(node *next, node *prev, const value_type &);
+      template <typename... Args>
+      node(node *next_, node *prev_, Args &&...args);
    };
+   using node_alloc = typename allocator_traits<
+       Alloc>::template rebind_alloc<node>;
+   using node_traits = allocator_traits<node_alloc>;
    node *anchor() { return static_cast<node *>(&anchor_); }
    link anchor_{anchor(), anchor()};
+   node_alloc nodes;
+   Index<node, Less, Alloc> index{less, Alloc()};
+   Values<node, Less, Alloc> values{less, Alloc()};
+   template <typename... Args>
+   node *make_node(Args &&...args);
+   void free_node(node *del);
+   iterator link_before(node *next, node *fresh);
+   template <typename Other>
+   bool is_key(node *found, const Other &key) const;
 
 public:
-   class iterator;
    listmap(){};
    listmap(const listmap &);
    listmap &operator=(const listmap &);
    ~listmap();
    iterator insert(const value_type &);
+   iterator insert(value_type &&);
+   template <typename... Args>
+   xpair<iterator, bool> emplace(Args &&...args);
+   template <typename... Args>
+   xpair<iterator, bool> try_emplace(const key_type &key,
+                                     Args &&...args);
+   template <typename... Args>
+   xpair<iterator, bool> try_emplace(key_type &&key, Args &&...args);
+   template <typename Other, typename Mapped>
+   xpair<iterator, bool> insert_or_assign(Other &&key, Mapped &&value);
    iterator find(const key_type &);
+   template <typename Other, class L = Less,
+             typename = typename L::is_transparent>
+   iterator find(const Other &);
+   template <typename Other>
+   iterator lower_bound(const Other &);
+   template <typename Other>
+   vector<iterator> find_value(const Other &);
    iterator erase(iterator position);
+   void clear();
    iterator begin() { return anchor()->next; }
    iterator end() { return anchor(); }
    bool empty() { return begin() == end(); }
 };
 
-template <typename Key, typename Value, class Less>
-class listmap<Key, Value, Less>::iterator
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+class listmap<Key, Value, Less, Index, Values, Alloc>::iterator
 {
 private:
-   friend class listmap<Key, Value, Less>;
-   listmap<Key, Value, Less>::node *where{nullptr};
+   friend class listmap<Key, Value, Less, Index, Values, Alloc>;
+   node *where{nullptr};
    iterator(node *where_) : where(where_){};
 
 public:
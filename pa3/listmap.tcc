@@ -10,13 +10,17 @@
 //
 
 //
-// listmap::node::node (link*, link*, const value_type&)
+// listmap::node::node (node*, node*, Args&&...)
 //
-template <typename Key, typename Value, class Less>
-listmap<Key, Value, Less>::node::node(
-    node *n, node *p,
-    const value_type &v)
-    : link(n, p), value(v) {}
+// The value is built from the rest of the arguments.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename... Args>
+listmap<Key, Value, Less, Index, Values, Alloc>::node::node(
+    node *n, node *p, Args &&...args)
+    : link(n, p), value(forward<Args>(args)...) {}
 
 //
 /////////////////////////////////////////////////////////////////
@@ -24,81 +28,318 @@ listmap<Key, Value, Less>::node::node(
 /////////////////////////////////////////////////////////////////
 //
 
+//
+// node* listmap::make_node (Args&&...)
+//
+// A node holding a value built from the arguments, not yet linked.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename... Args>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::node *
+listmap<Key, Value, Less, Index, Values, Alloc>::make_node(
+    Args &&...args)
+{
+   node *fresh = node_traits::allocate(nodes, 1);
+   try
+   {
+      node_traits::construct(nodes, fresh, nullptr, nullptr,
+                             forward<Args>(args)...);
+   }
+   catch (...)
+   {
+      node_traits::deallocate(nodes, fresh, 1);
+      throw;
+   }
+   return fresh;
+}
+
+//
+// void listmap::free_node (node*)
+//
+// Destroys the node and gives its memory back to the allocator.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+void listmap<Key, Value, Less, Index, Values, Alloc>::free_node(
+    node *del)
+{
+   node_traits::destroy(nodes, del);
+   node_traits::deallocate(nodes, del, 1);
+}
+
+//
+// iterator listmap::link_before (node*, node*)
+//
+// Links a new node into the list before next, and into the index.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::link_before(node *next,
+                                                     node *fresh)
+{
+   fresh->next = next;
+   fresh->prev = next->prev;
+   next->prev->next = fresh;
+   next->prev = fresh;
+   index.insert(fresh);
+   values.insert(fresh);
+   return iterator(fresh);
+}
+
+//
+// bool listmap::is_key (node*, const Other&)
+//
+// True if the node found by lower_bound holds the key.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename Other>
+bool listmap<Key, Value, Less, Index, Values, Alloc>::is_key(
+    node *found, const Other &key) const
+{
+   return found != &anchor_ and not less(key, found->value.first);
+}
+
 //
 // listmap::~listmap()
 //
-template <typename Key, typename Value, class Less>
-listmap<Key, Value, Less>::~listmap()
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+listmap<Key, Value, Less, Index, Values, Alloc>::~listmap()
 {
    DEBUGF('l', reinterpret_cast<const void *>(this));
+   clear();
 }
 
 //
 // iterator listmap::insert (const value_type&)
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::iterator
-listmap<Key, Value, Less>::insert(const value_type &pair)
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::insert(
+    const value_type &pair)
 {
    DEBUGF('l', &pair << "->" << pair);
-   node *newNode = new node(anchor(), anchor(), pair);
-   if (this->empty())
+   return insert_or_assign(pair.first, pair.second).first;
+}
+
+//
+// iterator listmap::insert (value_type&&)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::insert(
+    value_type &&pair)
+{
+   DEBUGF('l', &pair << "->" << pair);
+   return insert_or_assign(pair.first, move(pair.second)).first;
+}
+
+//
+// xpair<iterator,bool> listmap::emplace (Args&&...)
+//
+// The pair must be built to learn its key, and is thrown away if
+// the key is there.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename... Args>
+auto listmap<Key, Value, Less, Index, Values, Alloc>::emplace(
+    Args &&...args) -> xpair<iterator, bool>
+{
+   node *fresh = make_node(forward<Args>(args)...);
+   DEBUGF('l', fresh->value);
+   node *next = index.lower_bound(anchor(), fresh->value.first);
+   if (is_key(next, fresh->value.first))
    {
-      anchor()->next = newNode;
-      anchor()->prev = newNode;
-      newNode->prev = anchor();
-      newNode->next = anchor();
+      free_node(fresh);
+      return {iterator(next), false};
    }
-   else
+   return {link_before(next, fresh), true};
+}
+
+//
+// xpair<iterator,bool> listmap::try_emplace (const key_type&, ...)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename... Args>
+auto listmap<Key, Value, Less, Index, Values, Alloc>::try_emplace(
+    const key_type &key, Args &&...args) -> xpair<iterator, bool>
+{
+   DEBUGF('l', key);
+   node *next = index.lower_bound(anchor(), key);
+   if (is_key(next, key))
+      return {iterator(next), false};
+   return {link_before(next, make_node(key, mapped_type(forward<Args>(
+                                                 args)...))),
+           true};
+}
+
+//
+// xpair<iterator,bool> listmap::try_emplace (key_type&&, ...)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename... Args>
+auto listmap<Key, Value, Less, Index, Values, Alloc>::try_emplace(
+    key_type &&key, Args &&...args) -> xpair<iterator, bool>
+{
+   DEBUGF('l', key);
+   node *next = index.lower_bound(anchor(), key);
+   if (is_key(next, key))
+      return {iterator(next), false};
+   return {link_before(next,
+                       make_node(move(key), mapped_type(forward<Args>(
+                                                 args)...))),
+           true};
+}
+
+//
+// xpair<iterator,bool> listmap::insert_or_assign (Other&&, Mapped&&)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename Other, typename Mapped>
+auto listmap<Key, Value, Less, Index, Values, Alloc>::insert_or_assign(
+    Other &&key, Mapped &&value) -> xpair<iterator, bool>
+{
+   DEBUGF('l', key);
+   node *next = index.lower_bound(anchor(), key);
+   if (is_key(next, key))
    {
-      node *cur = anchor()->next;
-      for (; cur->value.first < pair.first && cur->next != anchor(); cur = cur->next)
-         ;
-      if (cur->value.first != pair.first)
-      {
-         newNode->next = cur->next;
-         newNode->prev = cur;
-         cur->next->prev = newNode;
-         cur->next = newNode;
-      }
-      else
-         cur->value.second = pair.second;
+      values.erase(next);
+      next->value.second = forward<Mapped>(value);
+      values.insert(next);
+      return {iterator(next), false};
    }
-   return iterator(newNode);
+   return {link_before(next, make_node(forward<Other>(key),
+                                       forward<Mapped>(value))),
+           true};
 }
 
 //
 // listmap::find(const key_type&)
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::iterator
-listmap<Key, Value, Less>::find(const key_type &that)
+// Returns end() unless the key is there.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::find(
+    const key_type &that)
+{
+   DEBUGF('l', that);
+   node *found = index.lower_bound(anchor(), that);
+   return is_key(found, that) ? iterator(found) : end();
+}
+
+//
+// listmap::find(const Other&)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename Other, class L, typename>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::find(const Other &that)
 {
    DEBUGF('l', that);
-   iterator found(begin());
-   for (; found != end() && less(found->first, that); ++found)
-      ;
+   node *found = index.lower_bound(anchor(), that);
+   return is_key(found, that) ? iterator(found) : end();
+}
+
+//
+// iterator listmap::lower_bound (const Other&)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename Other>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::lower_bound(
+    const Other &that)
+{
+   DEBUGF('l', that);
+   return iterator(index.lower_bound(anchor(), that));
+}
+
+//
+// vector<iterator> listmap::find_value (const Other&)
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+template <typename Other>
+auto listmap<Key, Value, Less, Index, Values, Alloc>::find_value(
+    const Other &value) -> vector<iterator>
+{
+   vector<iterator> found;
+   values.each_with(anchor(), value,
+                    [&found](node *with) { found.push_back(with); });
    return found;
 }
 
 //
 // iterator listmap::erase (iterator position)
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::iterator
-listmap<Key, Value, Less>::erase(iterator position)
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator
+listmap<Key, Value, Less, Index, Values, Alloc>::erase(
+    iterator position)
 {
    DEBUGF('l', &*position);
-   iterator del(begin());
-   for (; del != position; ++del)
-      ;
-   del.where->prev->next = del.where->next;
-   del.where->next->prev = del.where->prev;
-   node *next = del.where->next;
-   delete del.where;
+   node *del = position.where;
+   node *next = del->next;
+   index.erase(del);
+   values.erase(del);
+   del->prev->next = next;
+   next->prev = del->prev;
+   free_node(del);
    return iterator(next);
 }
 
+//
+// void listmap::clear()
+//
+// Frees every node in one pass, without unlinking them one by one.
+//
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+void listmap<Key, Value, Less, Index, Values, Alloc>::clear()
+{
+   DEBUGF('l', reinterpret_cast<const void *>(this));
+   for (node *cur = anchor()->next; cur != anchor();)
+   {
+      node *next = cur->next;
+      free_node(cur);
+      cur = next;
+   }
+   anchor()->next = anchor();
+   anchor()->prev = anchor();
+   index.clear();
+   values.clear();
+}
+
 //
 /////////////////////////////////////////////////////////////////
 // Operations on listmap::iterator.
@@ -108,9 +349,11 @@ listmap<Key, Value, Less>::erase(iterator position)
 //
 // listmap::value_type& listmap::iterator::operator*()
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::value_type &
-    listmap<Key, Value, Less>::iterator::operator*()
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::value_type &
+listmap<Key, Value, Less, Index, Values, Alloc>::iterator::operator*()
 {
    DEBUGF('l', where);
    return where->value;
@@ -119,9 +362,11 @@ typename listmap<Key, Value, Less>::value_type &
 //
 // listmap::value_type* listmap::iterator::operator->()
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::value_type *
-    listmap<Key, Value, Less>::iterator::operator->()
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::value_type *
+listmap<Key, Value, Less, Index, Values, Alloc>::iterator::operator->()
 {
    DEBUGF('l', where);
    return &(where->value);
@@ -130,9 +375,11 @@ typename listmap<Key, Value, Less>::value_type *
 //
 // listmap::iterator& listmap::iterator::operator++()
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::iterator &
-listmap<Key, Value, Less>::iterator::operator++()
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator &
+listmap<Key, Value, Less, Index, Values, Alloc>::iterator::operator++()
 {
    DEBUGF('l', where);
    where = where->next;
@@ -142,9 +389,11 @@ listmap<Key, Value, Less>::iterator::operator++()
 //
 // listmap::iterator& listmap::iterator::operator--()
 //
-template <typename Key, typename Value, class Less>
-typename listmap<Key, Value, Less>::iterator &
-listmap<Key, Value, Less>::iterator::operator--()
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+typename listmap<Key, Value, Less, Index, Values, Alloc>::iterator &
+listmap<Key, Value, Less, Index, Values, Alloc>::iterator::operator--()
 {
    DEBUGF('l', where);
    where = where->prev;
@@ -154,8 +403,11 @@ listmap<Key, Value, Less>::iterator::operator--()
 //
 // bool listmap::iterator::operator== (const iterator&)
 //
-template <typename Key, typename Value, class Less>
-inline bool listmap<Key, Value, Less>::iterator::operator==(
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+inline bool
+listmap<Key, Value, Less, Index, Values, Alloc>::iterator::operator==(
     const iterator &that) const
 {
    return this->where == that.where;
@@ -164,8 +416,11 @@ inline bool listmap<Key, Value, Less>::iterator::operator==(
 //
 // bool listmap::iterator::operator!= (const iterator&)
 //
-template <typename Key, typename Value, class Less>
-inline bool listmap<Key, Value, Less>::iterator::operator!=(
+template <typename Key, typename Value, class Less,
+          template <typename, class, class> class Index,
+          template <typename, class, class> class Values, class Alloc>
+inline bool
+listmap<Key, Value, Less, Index, Values, Alloc>::iterator::operator!=(
     const iterator &that) const
 {
    return this->where != that.where;
@@ -0,0 +1,137 @@
+// $Id: lmbench.cpp,v 1.1 2026-10-19 12:30:00-07 - - $
+
+// lmbench -
+//    Times the maps keyvalue can use on n random string keys and
+//    writes a JSON report to cout.  For each map it reports, in
+//    milliseconds, the time to insert the keys, to find each of
+//    them, to walk the map in order, to erase every entry through
+//    an iterator to the last one, and to insert the keys again and
+//    clear the map in one call.
+//
+//    lmbench [-n keys] [-r seed] [-l]
+//
+//    -l also times listmap with list_index, whose inserts are
+//       quadratic, so n should be small.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+#include "bplusmap.h"
+#include "listmap.h"
+#include "util.h"
+
+size_t key_count = 100000;
+unsigned seed = 1;
+bool with_list = false;
+
+void scan_options(int argc, char **argv)
+{
+   opterr = 0;
+   for (;;)
+   {
+      int option = getopt(argc, argv, "ln:r:");
+      if (option == EOF)
+         break;
+      switch (option)
+      {
+      case 'l':
+         with_list = true;
+         break;
+      case 'n':
+         key_count = strtoul(optarg, nullptr, 10);
+         break;
+      case 'r':
+         seed = strtoul(optarg, nullptr, 10);
+         break;
+      default:
+         complain() << "-" << char(optopt)
+                    << ": invalid option" << endl;
+         break;
+      }
+   }
+}
+
+// timer -
+//    Milliseconds since it was made or last read.
+
+class timer
+{
+private:
+   chrono::steady_clock::time_point start{chrono::steady_clock::now()};
+
+public:
+   double lap()
+   {
+      auto now = chrono::steady_clock::now();
+      chrono::duration<double, milli> elapsed = now - start;
+      start = now;
+      return elapsed.count();
+   }
+};
+
+template <typename Map>
+void run(const string &name, const vector<string> &keys,
+         const string &comma)
+{
+   using value_type = typename Map::value_type;
+   Map map;
+   timer clock;
+   for (size_t index = 0; index < keys.size(); ++index)
+      map.insert(value_type(keys[index], to_string(index)));
+   double insert = clock.lap();
+   size_t found = 0;
+   for (const string &key : keys)
+      found += map.find(key) != map.end();
+   double find = clock.lap();
+   size_t entries = 0;
+   for (auto itor = map.begin(); itor != map.end(); ++itor)
+      ++entries;
+   double walk = clock.lap();
+   while (not map.empty())
+      map.erase(--map.end());
+   double erase = clock.lap();
+   for (size_t index = 0; index < keys.size(); ++index)
+      map.insert(value_type(keys[index], to_string(index)));
+   clock.lap();
+   map.clear();
+   double clear = clock.lap();
+   cout << comma << endl
+        << "    \"" << name << "\": {"
+        << "\"entries\": " << entries << ", \"found\": " << found
+        << ", \"insert\": " << insert << ", \"find\": " << find
+        << ", \"walk\": " << walk << ", \"erase\": " << erase
+        << ", \"clear\": " << clear << "}";
+}
+
+int main(int argc, char **argv)
+{
+   sys_info::execname(argv[0]);
+   scan_options(argc, argv);
+   mt19937 random(seed);
+   vector<string> keys;
+   for (size_t index = 0; index < key_count; ++index)
+      keys.push_back("key" + to_string(random()));
+
+   cout << fixed << setprecision(3);
+   cout << "{" << endl;
+   cout << "  \"keys\": " << key_count << "," << endl;
+   cout << "  \"seed\": " << seed << "," << endl;
+   cout << "  \"ms\": {";
+   run<listmap<string, string>>("listmap", keys, "");
+   if (with_list)
+      run<listmap<string, string, xless<string>, list_index>>(
+          "listmap list_index", keys, ",");
+   run<bplusmap<string, string>>("bplusmap", keys, ",");
+   cout << endl
+        << "  }" << endl;
+   cout << "}" << endl;
+   return sys_info::exit_status();
+}
@@ -1,29 +1,42 @@
 // $Id: main.cpp,v 1.11 2018-01-25 14:19:29-08 - - $
 
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
 #include <exception>
 #include <iostream>
-#include <fstream>
-#include <regex>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 using namespace std;
 
+#include "kvio.h"
+#include "kvline.h"
+#include "kvstore.h"
 #include "listmap.h"
 #include "xpair.h"
 #include "util.h"
 
-using str_str_map = listmap<string, string>;
+using str_str_map =
+    listmap<string, string, xless<string>, tree_index, value_tree>;
 using str_str_pair = str_str_map::value_type;
 
+size_t jobs = 1;
+string store_dir;
+
 void scan_options(int argc, char **argv)
 {
    opterr = 0;
    for (;;)
    {
-      int option = getopt(argc, argv, "@:");
+      int option = getopt(argc, argv, "@:j:s:");
       if (option == EOF)
          break;
       switch (option)
@@ -31,6 +44,18 @@ void scan_options(int argc, char **argv)
       case '@':
          debugflags::setflags(optarg);
          break;
+      case 'j':
+         jobs = strtoul(optarg, nullptr, 10);
+         if (jobs == 0)
+         {
+            complain() << "-j " << optarg << ": invalid job count"
+                       << endl;
+            jobs = 1;
+         }
+         break;
+      case 's':
+         store_dir = optarg;
+         break;
       default:
          complain() << "-" << char(optopt)
                     << ": invalid option" << endl;
@@ -39,94 +64,180 @@ void scan_options(int argc, char **argv)
    }
 }
 
-int main(int argc, char **argv)
+// keyvalue -
+//    Runs the commands in one file against the map, which is a
+//    str_str_map or a kvstore, and writes what they print to out,
+//    flushing after each line if interactive.  Returns 0, or errno
+//    if the file can not be opened.
+
+template <typename Map>
+int keyvalue(const string &filename, Map &list, line_writer &out,
+             bool interactive)
 {
-   sys_info::execname(argv[0]);
-   scan_options(argc, argv);
+   line_reader filein(filename);
+   if (!filein)
+      return errno;
 
-   str_str_map inputs;
-   for (char **argp = &argv[optind]; argp != &argv[argc]; ++argp)
+   size_t lineNum = 0;
+   string_view in;
+   while (filein.next(in))
    {
-      str_str_pair pair(*argp, to_string<int>(argp - argv));
-      inputs.insert(pair);
+      lineNum++;
+      out << filename << ": " << lineNum << ": " << in << '\n';
+      kvline line = scan_kvline(in);
+      switch (line.kind)
+      {
+      case kv_kind::comment:
+         break;
+      case kv_kind::set:
+         list.insert_or_assign(line.key, line.value);
+         out << line.key << " = " << line.value << '\n';
+         break;
+      case kv_kind::erase:
+      {
+         auto found = list.find(line.key);
+         if (found != list.end())
+            list.erase(found);
+         break;
+      }
+      case kv_kind::find_value:
+         for (auto found : list.find_value(line.value))
+            out << found->first << " = " << found->second << '\n';
+         break;
+      case kv_kind::print_all:
+         for (const auto &printi : list)
+            out << printi.first << " = " << printi.second << '\n';
+         break;
+      case kv_kind::find_key:
+      {
+         auto found = list.find(line.key);
+         if (found == list.end())
+            out << line.key << ": key not found\n";
+         else
+            out << found->first << " = " << found->second << '\n';
+         break;
+      }
+      case kv_kind::invalid:
+         out.flush();
+         assert(false);
+      }
+      if (interactive)
+         out.flush();
    }
-   if (optind < 0 && argc == 1)
-      inputs.insert(str_str_pair("-", "1"));
+   return 0;
+}
+
+// input -
+//    One file named on the command line, and what it printed when
+//    run on a worker thread.
 
-   regex octothorpe{R"(^\s*(#.*)?$)"};
-   regex trim{R"(^\s*([^=]+?)\s*$)"};
-   regex equalsSplit{R"(^\s*(.*?)\s*=\s*(.*?)\s*$)"};
+struct input
+{
+   string filename;
+   line_writer out;
+   int error{0};
+   bool done{false};
+   input(const string &filename_) : filename(filename_) {}
+};
 
-   for (str_str_map::iterator itor = inputs.begin();
-        itor != inputs.end(); ++itor)
+// run_parallel -
+//    Runs the files on up to jobs worker threads, each file on one
+//    thread, and writes each file's output as soon as it and every
+//    file before it are done, so the output is in command line
+//    order.
+
+void run_parallel(vector<input> &inputs, line_writer &out)
+{
+   mutex lock;
+   condition_variable finished;
+   atomic<size_t> next{0};
+   auto work = [&]() {
+      for (size_t index; (index = next++) < inputs.size();)
+      {
+         input &file = inputs[index];
+         str_str_map list;
+         int error = keyvalue(file.filename, list, file.out, false);
+         lock_guard<mutex> guard(lock);
+         file.error = error;
+         file.done = true;
+         finished.notify_one();
+      }
+   };
+   vector<thread> pool;
+   for (size_t worker = 0; worker < min(jobs, inputs.size()); ++worker)
+      pool.emplace_back(work);
+   for (input &file : inputs)
    {
-      str_str_map list;
-      ifstream filein;
-      if (itor->first != "-")
       {
-         filein.open(itor->first);
-         if (!filein)
-         {
-            cerr << "keyvalue: " << itor->first
-                 << "No such file or directory" << endl;
-            continue;
-         }
+         unique_lock<mutex> guard(lock);
+         finished.wait(guard, [&file]() { return file.done; });
       }
+      if (file.error != 0)
+         complain() << file.filename << ": " << strerror(file.error)
+                    << endl;
+      out << file.out.text();
+      file.out.clear();
+   }
+   for (thread &worker : pool)
+      worker.join();
+}
+
+// run_stored -
+//    Runs the files one after another against the kvstore in
+//    store_dir, which keeps its entries from one file to the next and
+//    from one run to the next.  The log is synced after each file.
+//    The files share the store, so -j does not apply.
 
-      int lineNum = 0;
-      string in;
-      while (!(itor->first == "-" ? cin.eof() : filein.eof()))
+void run_stored(const vector<input> &inputs, line_writer &out)
+{
+   try
+   {
+      kvstore store(store_dir);
+      for (const input &file : inputs)
       {
-         getline((itor->first == "-" ? cin : filein), in);
-         lineNum++;
-         smatch result;
-         cout << itor->first << ": " << lineNum << ": " << in << endl;
-         if (regex_search(in, result, octothorpe))
-            continue;
-         if (regex_search(in, result, equalsSplit))
-            if (result[1].length() > 0)
-               if (result[2].length() > 0)
-               {
-                  list.insert(xpair<const string, string>(
-                      result[1], result[2]));
-                  std::cout << result[1] << " = " << result[2] << endl;
-               }
-               else
-                  list.erase(list.find(itor->first));
-            else
-            {
-               if (result[2].length() > 0)
-               {
-                  for (auto printi : list)
-                     if (printi.second == result[2])
-                        std::cout << printi.first << " = "
-                                  << printi.second << endl;
-               }
-               else
-                  for (auto printi : list)
-                     std::cout << printi.first << " = "
-                               << printi.second << endl;
-            }
-         else if (regex_search(in, result, trim))
-            if (list.find(result[1]) == list.end())
-               std::cout << result[1] << ": key not found" << endl;
-            else
-               std::cout << list.find(result[1])->first << " = "
-                         << list.find(result[1])->second << endl;
-         else
-            assert(false);
+         bool interactive =
+             file.filename == "-" and isatty(STDIN_FILENO);
+         int error = keyvalue(file.filename, store, out, interactive);
+         if (error != 0)
+            complain() << file.filename << ": " << strerror(error)
+                       << endl;
+         store.sync();
       }
-      for (str_str_map::iterator litor = list.begin();
-           litor != list.end(); litor = list.erase(litor))
-         ;
-
-      if (itor->first != "-")
-         filein.close();
    }
+   catch (kvstore_error &error)
+   {
+      out.flush();
+      complain() << error.what() << endl;
+   }
+}
+
+int main(int argc, char **argv)
+{
+   sys_info::execname(argv[0]);
+   scan_options(argc, argv);
+
+   vector<input> inputs;
+   for (char **argp = &argv[optind]; argp != &argv[argc]; ++argp)
+      inputs.emplace_back(*argp);
+   if (inputs.empty())
+      inputs.emplace_back("-");
 
-   for (str_str_map::iterator itor = inputs.begin();
-        itor != inputs.end(); itor = inputs.erase(itor))
-      ;
+   line_writer out(STDOUT_FILENO);
+   if (not store_dir.empty())
+      run_stored(inputs, out);
+   else if (jobs > 1 and inputs.size() > 1)
+      run_parallel(inputs, out);
+   else
+      for (const input &file : inputs)
+      {
+         str_str_map list;
+         bool interactive =
+             file.filename == "-" and isatty(STDIN_FILENO);
+         int error = keyvalue(file.filename, list, out, interactive);
+         if (error != 0)
+            complain() << file.filename << ": " << strerror(error)
+                       << endl;
+      }
 
-   return EXIT_SUCCESS;
+   return sys_info::exit_status();
 }
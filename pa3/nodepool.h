@@ -0,0 +1,147 @@
+// $Id: nodepool.h,v 1.1 2026-10-19 12:40:00-07 - - $
+
+#ifndef __NODEPOOL_H__
+#define __NODEPOOL_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+//
+// node_pool -
+//    An allocator that hands out single objects from slabs it owns.
+//    Each slab holds twice as many objects as the one before, up to
+//    a limit.  Freed objects go on a free list and are reused before
+//    a new slab is taken, and every slab is returned at once when
+//    the pool is destroyed.  Requests for more than one object go
+//    to the heap as usual.
+//
+//    Each pool belongs to one container:  a copy or a rebound pool
+//    starts empty, and pools compare equal only to themselves.  Not
+//    locked.
+//
+
+template <typename Type>
+class node_pool
+{
+public:
+   using value_type = Type;
+   template <typename Other>
+   struct rebind
+   {
+      using other = node_pool<Other>;
+   };
+   using propagate_on_container_copy_assignment = false_type;
+   using propagate_on_container_move_assignment = false_type;
+   using propagate_on_container_swap = false_type;
+
+private:
+   union block
+   {
+      block *next;
+      alignas(Type) unsigned char object[sizeof(Type)];
+   };
+   static constexpr size_t first_slab = 64;
+   static constexpr size_t largest_slab = 65536;
+   vector<block *> slabs;
+   block *free_list{nullptr};
+   size_t per_slab{first_slab};
+   void grow();
+
+public:
+   node_pool() = default;
+   node_pool(const node_pool &) : node_pool() {}
+   template <typename Other>
+   node_pool(const node_pool<Other> &) : node_pool() {}
+   node_pool &operator=(const node_pool &) { return *this; }
+   ~node_pool();
+   Type *allocate(size_t count);
+   void deallocate(Type *pointer, size_t count);
+   size_t slab_count() const { return slabs.size(); }
+};
+
+template <typename Type, typename Other>
+bool operator==(const node_pool<Type> &left,
+                const node_pool<Other> &right)
+{
+   return static_cast<const void *>(&left) ==
+          static_cast<const void *>(&right);
+}
+
+template <typename Type, typename Other>
+bool operator!=(const node_pool<Type> &left,
+                const node_pool<Other> &right)
+{
+   return not(left == right);
+}
+
+//
+// void node_pool::grow()
+//
+// Threads a new slab onto the free list.
+//
+template <typename Type>
+void node_pool<Type>::grow()
+{
+   block *slab = allocator<block>().allocate(per_slab);
+   slabs.push_back(slab);
+   for (size_t index = per_slab; index > 0; --index)
+   {
+      slab[index - 1].next = free_list;
+      free_list = &slab[index - 1];
+   }
+   per_slab = min(2 * per_slab, largest_slab);
+}
+
+//
+// node_pool::~node_pool()
+//
+// Returns every slab, whether or not its objects were freed.
+//
+template <typename Type>
+node_pool<Type>::~node_pool()
+{
+   size_t size = first_slab;
+   for (block *slab : slabs)
+   {
+      allocator<block>().deallocate(slab, size);
+      size = min(2 * size, largest_slab);
+   }
+}
+
+//
+// Type* node_pool::allocate (size_t)
+//
+template <typename Type>
+Type *node_pool<Type>::allocate(size_t count)
+{
+   if (count != 1)
+      return allocator<Type>().allocate(count);
+   if (free_list == nullptr)
+      grow();
+   block *taken = free_list;
+   free_list = taken->next;
+   return reinterpret_cast<Type *>(taken->object);
+}
+
+//
+// void node_pool::deallocate (Type*, size_t)
+//
+template <typename Type>
+void node_pool<Type>::deallocate(Type *pointer, size_t count)
+{
+   if (count != 1)
+   {
+      allocator<Type>().deallocate(pointer, count);
+      return;
+   }
+   block *freed = reinterpret_cast<block *>(pointer);
+   freed->next = free_list;
+   free_list = freed;
+}
+
+#endif
@@ -0,0 +1,192 @@
+// $Id: scanbench.cpp,v 1.1 2026-10-19 13:20:00-07 - - $
+
+// scanbench -
+//    Times how keyvalue splits the lines of each file:  once with
+//    scan_kvline and once with the three regular expressions it
+//    used before, and checks that both find the same kind, key and
+//    value on every line.  Writes a JSON report to cout with the
+//    time in milliseconds and the rate in megabytes per second of a
+//    pass that only reads the lines, and of each way of splitting
+//    them, which includes reading them.
+//
+//    scanbench [-x] file...
+//
+//    -x skips the regular expressions, which are slow enough that
+//       a file of several gigabytes takes a long time.
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+using namespace std;
+
+#include "kvline.h"
+#include "util.h"
+
+bool skip_regex = false;
+
+void scan_options(int argc, char **argv)
+{
+   opterr = 0;
+   for (;;)
+   {
+      int option = getopt(argc, argv, "x");
+      if (option == EOF)
+         break;
+      switch (option)
+      {
+      case 'x':
+         skip_regex = true;
+         break;
+      default:
+         complain() << "-" << char(optopt)
+                    << ": invalid option" << endl;
+         break;
+      }
+   }
+}
+
+// timer -
+//    Milliseconds since it was made or last read.
+
+class timer
+{
+private:
+   chrono::steady_clock::time_point start{chrono::steady_clock::now()};
+
+public:
+   double lap()
+   {
+      auto now = chrono::steady_clock::now();
+      chrono::duration<double, milli> elapsed = now - start;
+      start = now;
+      return elapsed.count();
+   }
+};
+
+// regex_kvline -
+//    What keyvalue found with regular expressions.
+
+const regex octothorpe{R"(^\s*(#.*)?$)"};
+const regex trim{R"(^\s*([^=]+?)\s*$)"};
+const regex equalsSplit{R"(^\s*(.*?)\s*=\s*(.*?)\s*$)"};
+
+string_view field(const string &line, const smatch &result,
+                  size_t group)
+{
+   return string_view(line.data() + result.position(group),
+                      result.length(group));
+}
+
+kvline regex_kvline(const string &in)
+{
+   kvline line;
+   smatch result;
+   if (regex_search(in, result, octothorpe))
+      line.kind = kv_kind::comment;
+   else if (regex_search(in, result, equalsSplit))
+   {
+      line.key = field(in, result, 1);
+      line.value = field(in, result, 2);
+      if (line.key.empty())
+         line.kind = line.value.empty() ? kv_kind::print_all
+                                        : kv_kind::find_value;
+      else
+         line.kind = line.value.empty() ? kv_kind::erase
+                                        : kv_kind::set;
+   }
+   else if (regex_search(in, result, trim))
+   {
+      line.key = field(in, result, 1);
+      line.kind = kv_kind::find_key;
+   }
+   return line;
+}
+
+// pass -
+//    Reads every line of the file and hands it to split.  The
+//    checksum keeps the work from being optimized away.
+
+template <typename Split>
+size_t pass(const char *filename, size_t &bytes, Split split)
+{
+   ifstream file(filename);
+   size_t checksum = 0;
+   bytes = 0;
+   string in;
+   while (getline(file, in))
+   {
+      bytes += in.size() + 1;
+      checksum += split(in);
+   }
+   return checksum;
+}
+
+void report(const char *name, double ms, size_t bytes,
+            const char *comma)
+{
+   cout << "\"" << name << "\": {\"ms\": " << ms
+        << ", \"MB/s\": " << (ms > 0 ? bytes / ms / 1000 : 0) << "}"
+        << comma;
+}
+
+int main(int argc, char **argv)
+{
+   sys_info::execname(argv[0]);
+   scan_options(argc, argv);
+   cout << fixed << setprecision(3);
+   cout << "{";
+   for (char **argp = &argv[optind]; argp != &argv[argc]; ++argp)
+   {
+      if (not ifstream(*argp))
+      {
+         complain() << *argp << ": No such file or directory" << endl;
+         continue;
+      }
+      size_t bytes = 0;
+      timer clock;
+      pass(*argp, bytes, [](const string &in) { return in.size(); });
+      double read = clock.lap();
+      pass(*argp, bytes, [](const string &in) {
+         kvline line = scan_kvline(in);
+         return static_cast<size_t>(line.kind) + line.key.size() +
+                line.value.size();
+      });
+      double scan = clock.lap();
+      cout << (argp == &argv[optind] ? "" : ",") << endl
+           << "  \"" << *argp << "\": {\"bytes\": " << bytes << ", ";
+      report("read", read, bytes, ", ");
+      if (skip_regex)
+      {
+         report("scan", scan, bytes, "}");
+         continue;
+      }
+      report("scan", scan, bytes, ", ");
+      size_t mismatches = pass(*argp, bytes, [](const string &in) {
+         kvline line = scan_kvline(in);
+         kvline expected = regex_kvline(in);
+         return line.kind != expected.kind or
+                line.key != expected.key or
+                line.value != expected.value;
+      });
+      clock.lap();
+      pass(*argp, bytes, [](const string &in) {
+         kvline line = regex_kvline(in);
+         return static_cast<size_t>(line.kind) + line.key.size() +
+                line.value.size();
+      });
+      double matched = clock.lap();
+      report("regex", matched, bytes, ", ");
+      cout << "\"mismatches\": " << mismatches << "}";
+      if (mismatches > 0)
+         sys_info::exit_status(EXIT_FAILURE);
+   }
+   cout << endl
+        << "}" << endl;
+   return sys_info::exit_status();
+}
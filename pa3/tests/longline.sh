@@ -0,0 +1,12 @@
+#!/bin/sh
+# $Id: longline.sh,v 1.1 2026-10-19 15:10:00-07 - - $
+# A last line of a whole block or more with no newline, read from a
+# pipe so that keyvalue has to grow its block to hold it.  Runs of
+# the letter are squeezed so the expected output stays short.
+for size in 65535 65536 65537 200000
+do
+   { echo "x = 1"
+     echo "x"
+     head -c $size /dev/zero | tr '\0' a
+   } | ./keyvalue | tr -s a
+done
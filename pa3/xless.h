@@ -6,12 +6,21 @@
 //
 // We assume that the type type_t has an operator< function.
 //
+// xless is transparent:  it also compares a Type with anything that
+// has an operator< with it, such as a string with a string_view, so
+// that maps can look up keys without building a Type first.
+//
 
 template <typename Type>
 struct xless {
+   using is_transparent = void;
    bool operator() (const Type& left, const Type& right) const {
       return left < right;
    }
+   template <typename Left, typename Right>
+   bool operator() (const Left& left, const Right& right) const {
+      return left < right;
+   }
 };
 
 #endif
@@ -4,6 +4,7 @@
 #define __XPAIR_H__
 
 #include <iostream>
+#include <utility>
 
 using namespace std;
 
@@ -23,6 +24,10 @@ struct xpair {
    xpair(){}
    xpair (const first_t& first_, const second_t& second_):
                 first(first_), second(second_) {}
+   template <typename first_arg, typename second_arg>
+   xpair (first_arg&& first_, second_arg&& second_):
+                first(forward<first_arg>(first_)),
+                second(forward<second_arg>(second_)) {}
 };
 
 template <typename first_t, typename second_t>